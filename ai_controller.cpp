@@ -0,0 +1,50 @@
+#include "ai_controller.h"
+#include <math.h>
+
+void AiObservations::resize(int matches) {
+  count = matches;
+  paddleY.resize(matches);
+  opponentY.resize(matches);
+  ballX.resize(matches);
+  ballY.resize(matches);
+  ballVelX.resize(matches);
+  ballVelY.resize(matches);
+  ballInPlay.resize(matches);
+}
+
+void AiObservations::observe(int index, const GameState* game, bool leftPaddle) {
+  const Paddle& paddle = leftPaddle ? game->paddleLeft : game->paddleRight;
+  const Paddle& opponent = leftPaddle ? game->paddleRight : game->paddleLeft;
+  const Ball& ball = game->ball;
+  paddleY[index] = paddle.rect.y + PADDLE_HEIGHT / 2;
+  opponentY[index] = opponent.rect.y + PADDLE_HEIGHT / 2;
+  Real centerX = ball.rect.x + BALL_RADIUS;
+  ballX[index] = leftPaddle ? WINDOW_WIDTH - centerX : centerX;
+  ballY[index] = ball.rect.y + BALL_RADIUS;
+  ballVelX[index] = leftPaddle ? -ball.velX : ball.velX;
+  ballVelY[index] = -ball.velY;
+  ballInPlay[index] = ball.rect.y >= 0; // It's parked above the screen while waiting
+}
+
+void ChaseController::decide(const AiObservations& observations, Real* velocities) {
+  // The same sums as updateAi in the same order so the results match it bit for bit
+  Real up = settings.speedMultiplier * PADDLE_SPEED, down = settings.speedMultiplier * -PADDLE_SPEED;
+  for (int i = 0; i < observations.count; ++i) {
+    Real distance = observations.ballInPlay[i] ? observations.paddleY[i] - observations.ballY[i] : Real(0);
+    Real velocity = distance > 1 ? up : down;
+    velocities[i] = fabs(distance) > settings.deadZone ? velocity : Real(0);
+  }
+}
+
+void controlPaddles(AiController* controller, GameState** games, int count, bool leftPaddle,
+    AiObservations* observations, std::vector<Real>* velocities) {
+  observations->resize(count);
+  velocities->resize(count);
+  for (int i = 0; i < count; ++i) {
+    observations->observe(i, games[i], leftPaddle);
+  }
+  controller->decide(*observations, velocities->data());
+  for (int i = 0; i < count; ++i) {
+    (leftPaddle ? games[i]->paddleLeft : games[i]->paddleRight).velocity = (*velocities)[i];
+  }
+}
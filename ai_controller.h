@@ -0,0 +1,50 @@
+#ifndef AI_CONTROLLER_H
+#define AI_CONTROLLER_H
+
+#include <vector>
+#include "game.h"
+
+// What AI controllers get to see of a batch of matches, each field is an array with an entry per
+// match so a policy can run down them with SIMD. Everything is mirrored so the paddle being
+// controlled is on the right, which lets the same controller play either side.
+struct AiObservations {
+  int count = 0;
+  std::vector<Real> paddleY; // Center of the controlled paddle
+  std::vector<Real> opponentY; // Center of the other paddle
+  std::vector<Real> ballX, ballY; // Center of the ball
+  std::vector<Real> ballVelX, ballVelY; // Screen space, positive towards the paddle and down
+  std::vector<uint8_t> ballInPlay; // 0 while the ball waits to be served
+
+  void resize(int matches);
+  // Fills in the entry at index from the match, seen from the left or right paddle
+  void observe(int index, const GameState* game, bool leftPaddle);
+};
+
+// Decides how a paddle moves for a whole batch of matches at once, so a policy that costs
+// more than the built in AIs (a lookup table, a small neural network) can spread its setup
+// over many matches
+class AiController {
+public:
+  virtual ~AiController() {}
+  // Writes each match's paddle velocity, positive going up like Paddle::velocity and no
+  // faster than PADDLE_SPEED
+  virtual void decide(const AiObservations& observations, Real* velocities) = 0;
+};
+
+// The left paddle's built in AI as a controller, it gives exactly the same velocities as updateAi
+class ChaseController : public AiController {
+public:
+  explicit ChaseController(const AiSettings& settings) : settings(settings) {}
+  void decide(const AiObservations& observations, Real* velocities) override;
+
+private:
+  AiSettings settings;
+};
+
+// Observes the paddle in every match, asks the controller to decide for all of them, then sets
+// the paddles' velocities. Call it between beginGameplayStep and finishGameplayStep with
+// player1Ai or player2Ai turned off for the paddles so the built in AI leaves them alone.
+void controlPaddles(AiController* controller, GameState** games, int count, bool leftPaddle,
+  AiObservations* observations, std::vector<Real>* velocities);
+
+#endif
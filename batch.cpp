@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <sstream>
+#include <time.h>
+#include "game.h"
+#include "event_sim.h"
+#include "ai_controller.h"
+
+// Plays many AI against AI matches across every core and reports how each right paddle AI did
+
+const int DEFAULT_MATCHES = 1000;
+const int LOCKSTEP_MATCHES = 64;
+
+// One match to play, the right AI uses the setting at settingIndex
+struct MatchTask {
+  int settingIndex;
+  int matchIndex;
+};
+
+// Totals for every match played with one setting
+struct BatchStats {
+  long long matches = 0;
+  long long leftWins = 0, rightWins = 0, abandoned = 0;
+  long long points = 0;
+  long long paddleHits = 0;
+  long long steps = 0;
+};
+
+// Each worker has its own queue, it takes work from the back of its own and steals from the
+// front of everybody else's once it runs out so long matches don't hold up the batch
+struct WorkQueue {
+  std::mutex mutex;
+  std::deque<MatchTask> tasks;
+};
+
+bool takeTask(WorkQueue* queue, bool steal, MatchTask* task) {
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  if (queue->tasks.empty()) {
+    return false;
+  }
+  if (steal) {
+    *task = queue->tasks.front();
+    queue->tasks.pop_front();
+  } else {
+    *task = queue->tasks.back();
+    queue->tasks.pop_back();
+  }
+  return true;
+}
+
+// A match being played and what's been counted of it so far
+struct ActiveMatch {
+  MatchTask task;
+  GameState game;
+  long long steps = 0;
+  int rallyHits = 0;
+  double time = 0; // Milliseconds played when event driven
+  bool won = false;
+};
+
+void startMatch(const MatchTask& task, const PredictiveAiSettings& rightAi, uint64_t seed, ActiveMatch* match) {
+  *match = ActiveMatch();
+  match->task = task;
+  initGame(&match->game, seed + task.matchIndex);
+  match->game.player1Ai = true;
+  match->game.player2Ai = true;
+  match->game.aiRight = rightAi;
+}
+
+// Counts what happened since the last step or event
+void countEvents(ActiveMatch* match, BatchStats* stats) {
+  // A step is short enough that it never has more than one paddle hit or point
+  if (match->game.soundEvents & SOUND_PADDLE) ++match->rallyHits;
+  if (match->game.soundEvents & SOUND_SCORE) {
+    // Only finished rallies count towards the rally length
+    stats->paddleHits += match->rallyHits;
+    match->rallyHits = 0;
+  }
+  match->game.soundEvents = 0;
+}
+
+bool matchOver(const ActiveMatch& match) {
+  return match.won || match.steps >= MAX_MATCH_STEPS;
+}
+
+void finishMatch(const ActiveMatch& match, BatchStats* stats) {
+  ++stats->matches;
+  stats->steps += match.steps;
+  stats->points += match.game.paddleLeft.score + match.game.paddleRight.score;
+  if (!match.won) {
+    ++stats->abandoned;
+  } else if (match.game.paddleLeft.score > match.game.paddleRight.score) {
+    ++stats->leftWins;
+  } else {
+    ++stats->rightWins;
+  }
+}
+
+void playEventDriven(ActiveMatch* match, BatchStats* stats) {
+  while (!matchOver(*match)) {
+    // Counted in whole steps for the stats, an event never has more than one hit or point either.
+    // Going at most a second at a time keeps the time in range of a fixed point Real.
+    double left = (MAX_MATCH_STEPS - match->steps) * double(SIMULATION_STEP);
+    match->time += float(advanceToNextEvent(&match->game, Real(float(std::min(left, 1000.0)))));
+    match->steps = std::min(MAX_MATCH_STEPS, (long long)(match->time / SIMULATION_STEP + 0.5));
+    match->won = match->game.gameOver;
+    countEvents(match, stats);
+  }
+}
+
+bool nextTask(std::vector<WorkQueue>* queues, int workerIndex, MatchTask* task) {
+  int workers = queues->size();
+  bool found = takeTask(&(*queues)[workerIndex], false, task);
+  for (int i = 1; !found && i < workers; ++i) {
+    found = takeTask(&(*queues)[(workerIndex + i) % workers], true, task);
+  }
+  return found; // Nothing is ever added once the workers start, so once it's empty everything is done
+}
+
+void runWorker(int workerIndex, std::vector<WorkQueue>* queues, const std::vector<PredictiveAiSettings>* settings,
+    uint64_t seed, bool eventDriven, std::vector<BatchStats>* stats) {
+  MatchTask task;
+  if (eventDriven) {
+    ActiveMatch match;
+    while (nextTask(queues, workerIndex, &task)) {
+      startMatch(task, (*settings)[task.settingIndex], seed, &match);
+      playEventDriven(&match, &(*stats)[task.settingIndex]);
+      finishMatch(match, &(*stats)[task.settingIndex]);
+    }
+    return;
+  }
+
+  // Stepped matches are played LOCKSTEP_MATCHES at a time so the left paddle's controller
+  // decides for all of them at once, finished ones are swapped out for new ones as they end
+  ChaseController leftController(AiSettings{});
+  AiObservations observations;
+  std::vector<Real> velocities;
+  std::vector<ActiveMatch> active;
+  std::vector<GameState*> games;
+  active.reserve(LOCKSTEP_MATCHES);
+  bool tasksLeft = true;
+  while (true) {
+    while (tasksLeft && int(active.size()) < LOCKSTEP_MATCHES) {
+      tasksLeft = nextTask(queues, workerIndex, &task);
+      if (tasksLeft) {
+        active.emplace_back();
+        startMatch(task, (*settings)[task.settingIndex], seed, &active.back());
+        active.back().game.player1Ai = false;
+      }
+    }
+    if (active.empty()) {
+      return;
+    }
+
+    games.clear();
+    for (ActiveMatch& match : active) {
+      beginGameplayStep(&match.game, SIMULATION_STEP);
+      games.push_back(&match.game);
+    }
+    controlPaddles(&leftController, games.data(), games.size(), true, &observations, &velocities);
+    for (size_t i = 0; i < active.size();) {
+      ActiveMatch& match = active[i];
+      match.won = finishGameplayStep(&match.game, SIMULATION_STEP);
+      ++match.steps;
+      countEvents(&match, &(*stats)[match.task.settingIndex]);
+      if (matchOver(match)) {
+        finishMatch(match, &(*stats)[match.task.settingIndex]);
+        match = active.back();
+        active.pop_back();
+      } else {
+        ++i;
+      }
+    }
+  }
+}
+
+// Reads a comma separated list of numbers, none of them negative
+bool parseList(const std::string& text, std::vector<float>* values) {
+  values->clear();
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    char* end;
+    float value = strtof(item.c_str(), &end);
+    if (item.empty() || *end != '\0' || value < 0) {
+      return false;
+    }
+    values->push_back(value);
+  }
+  return !values->empty();
+}
+
+void printUsage() {
+  std::cout << "Usage: pong-batch [--matches <count>] [--seed <seed>] [--threads <count>]\n"
+    << "                  [--reaction <list>] [--aim-error <list>] [--event-driven]\n"
+    << "  --matches    Matches to play for every right AI setting\n"
+    << "  --seed       Seed of the first match, each match after it adds one\n"
+    << "  --threads    Worker threads, defaults to the number of cores\n"
+    << "  --reaction   Comma separated right AI reaction delays in milliseconds to try\n"
+    << "  --aim-error  Comma separated right AI aim errors in pixels to try\n"
+    << "  --event-driven  Jump from one ball event to the next instead of stepping, much faster\n"
+    << "               but only close to the stepped results rather than the same\n"
+    << "The left AI always uses the default settings.\n";
+}
+
+int main(int argc, char *argv[]) {
+  int matches = DEFAULT_MATCHES;
+  uint64_t seed = time(0);
+  int threads = std::thread::hardware_concurrency();
+  std::vector<float> reactionDelays {float(PredictiveAiSettings().reactionDelay)};
+  std::vector<float> aimErrors {float(PredictiveAiSettings().aimError)};
+  bool eventDriven = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool valid = i + 1 < argc;
+    if (arg == "--event-driven") {
+      eventDriven = true;
+      valid = true;
+    } else if (valid && arg == "--matches") {
+      matches = atoi(argv[++i]);
+      valid = matches > 0;
+    } else if (valid && arg == "--seed") {
+      seed = strtoull(argv[++i], NULL, 10);
+    } else if (valid && arg == "--threads") {
+      threads = atoi(argv[++i]);
+      valid = threads > 0;
+    } else if (valid && arg == "--reaction") {
+      valid = parseList(argv[++i], &reactionDelays);
+    } else if (valid && arg == "--aim-error") {
+      valid = parseList(argv[++i], &aimErrors);
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      printUsage();
+      return 1;
+    }
+  }
+  if (threads <= 0) threads = 1;
+
+  // Every combination of the swept settings
+  std::vector<PredictiveAiSettings> settings;
+  for (float reactionDelay : reactionDelays) {
+    for (float aimError : aimErrors) {
+      PredictiveAiSettings setting;
+      setting.reactionDelay = reactionDelay;
+      setting.aimError = aimError;
+      settings.push_back(setting);
+    }
+  }
+
+  // Deal the matches out round robin so every worker starts with a mix of settings
+  std::vector<WorkQueue> queues(threads);
+  int task = 0;
+  for (int settingIndex = 0; settingIndex < int(settings.size()); ++settingIndex) {
+    for (int matchIndex = 0; matchIndex < matches; ++matchIndex) {
+      queues[task++ % threads].tasks.push_back({settingIndex, matchIndex});
+    }
+  }
+
+  // Each worker keeps its own totals which are combined once they're all done
+  std::vector<std::vector<BatchStats>> workerStats(threads, std::vector<BatchStats>(settings.size()));
+  auto startTime = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; ++i) {
+    workers.emplace_back(runWorker, i, &queues, &settings, seed, eventDriven, &workerStats[i]);
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+  std::cout << "Seed: " << seed << ", threads: " << threads << "\n";
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "reaction\taim error\tright win rate\tleft win rate\tabandoned\trally length\tpoints/min\n";
+  long long totalMatches = 0, totalSteps = 0;
+  for (size_t settingIndex = 0; settingIndex < settings.size(); ++settingIndex) {
+    BatchStats stats;
+    for (const std::vector<BatchStats>& worker : workerStats) {
+      const BatchStats& part = worker[settingIndex];
+      stats.matches += part.matches;
+      stats.leftWins += part.leftWins;
+      stats.rightWins += part.rightWins;
+      stats.abandoned += part.abandoned;
+      stats.points += part.points;
+      stats.paddleHits += part.paddleHits;
+      stats.steps += part.steps;
+    }
+    totalMatches += stats.matches;
+    totalSteps += stats.steps;
+    double minutes = stats.steps * SIMULATION_STEP / 60000.0;
+    std::cout << float(settings[settingIndex].reactionDelay) << "\t\t"
+      << float(settings[settingIndex].aimError) << "\t\t"
+      << double(stats.rightWins) / stats.matches << "\t\t"
+      << double(stats.leftWins) / stats.matches << "\t\t"
+      << double(stats.abandoned) / stats.matches << "\t\t"
+      // Paddle hits per point
+      << (stats.points > 0 ? double(stats.paddleHits) / stats.points : 0.0) << "\t\t"
+      << (minutes > 0 ? stats.points / minutes : 0.0) << "\n";
+  }
+  std::cout << std::setprecision(1) << totalMatches << " matches in " << seconds << " s ("
+    << totalMatches / std::max(seconds, 1e-9) << " matches/s, "
+    << totalSteps / std::max(seconds, 1e-9) << " steps/s)\n";
+  return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef BIT_STREAM_H
+#define BIT_STREAM_H
+
+#include <stdint.h>
+
+// Packs values into a byte buffer a few bits at a time, lowest bits first, for packets where
+// every byte counts. Going past the end sets overflowed instead of writing or reading out of bounds.
+
+class BitWriter {
+public:
+  BitWriter(uint8_t* buffer, int capacity) : buffer(buffer), capacity(capacity) {}
+  void write(uint32_t value, int bits) {
+    for (int i = 0; i < bits; ++i) {
+      int byte = position >> 3;
+      if (byte >= capacity) {
+        failed = true;
+        return;
+      }
+      if ((position & 7) == 0) buffer[byte] = 0;
+      buffer[byte] |= ((value >> i) & 1) << (position & 7);
+      ++position;
+    }
+  }
+  bool overflowed() const { return failed; }
+  int bytes() const { return (position + 7) >> 3; }
+
+private:
+  uint8_t* buffer;
+  int capacity;
+  int position = 0; // In bits
+  bool failed = false;
+};
+
+class BitReader {
+public:
+  BitReader(const uint8_t* buffer, int size) : buffer(buffer), size(size) {}
+  uint32_t read(int bits) {
+    uint32_t value = 0;
+    for (int i = 0; i < bits; ++i) {
+      int byte = position >> 3;
+      if (byte >= size) {
+        failed = true;
+        return 0;
+      }
+      value |= uint32_t((buffer[byte] >> (position & 7)) & 1) << i;
+      ++position;
+    }
+    return value;
+  }
+  bool overflowed() const { return failed; }
+
+private:
+  const uint8_t* buffer;
+  int size;
+  int position = 0;
+  bool failed = false;
+};
+
+#endif
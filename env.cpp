@@ -0,0 +1,44 @@
+#include "env.h"
+
+VectorEnv::VectorEnv(int matches) : games(matches), matchSteps(matches), rewardBuffer(matches), doneBuffer(matches) {
+  observed.resize(matches);
+}
+
+void VectorEnv::startMatch(int index) {
+  GameState& game = games[index];
+  game.player1Ai = false; // The policy
+  game.player2Ai = true;
+  game.paddleLeft.velocity = 0.0f;
+  matchSteps[index] = 0;
+}
+
+void VectorEnv::reset(const uint64_t* seeds) {
+  for (int i = 0; i < size(); ++i) {
+    games[i] = GameState();
+    initGame(&games[i], seeds[i]);
+    startMatch(i);
+    rewardBuffer[i] = 0.0f;
+    doneBuffer[i] = 0;
+    observed.observe(i, &games[i], true);
+  }
+}
+
+void VectorEnv::step(const uint8_t* actions) {
+  for (int i = 0; i < size(); ++i) {
+    GameState& game = games[i];
+    int leftScore = game.paddleLeft.score, rightScore = game.paddleRight.score;
+    beginGameplayStep(&game, SIMULATION_STEP);
+    game.paddleLeft.velocity = actions[i] == ACTION_UP ? PADDLE_SPEED :
+      actions[i] == ACTION_DOWN ? -PADDLE_SPEED : Real(0);
+    bool won = finishGameplayStep(&game, SIMULATION_STEP);
+    game.soundEvents = 0;
+    rewardBuffer[i] = float(game.paddleLeft.score - leftScore) - float(game.paddleRight.score - rightScore);
+    doneBuffer[i] = won || ++matchSteps[i] >= MAX_MATCH_STEPS;
+    if (doneBuffer[i]) {
+      // The same seed carries on so the next match is still decided by the one reset was given
+      restartGame(&game);
+      startMatch(i);
+    }
+    observed.observe(i, &game, true);
+  }
+}
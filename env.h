@@ -0,0 +1,44 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <vector>
+#include "game.h"
+#include "ai_controller.h"
+
+// Many matches for training a paddle policy without SDL. The policy plays the left paddle
+// against the built in right AI and is given the same mirrored observations as an
+// AiController. Every step advances all the matches by one SIMULATION_STEP.
+class VectorEnv {
+public:
+  // What the policy can do each step
+  enum Action : uint8_t {
+    ACTION_STAY = 0,
+    ACTION_UP = 1,
+    ACTION_DOWN = 2
+  };
+
+  explicit VectorEnv(int matches);
+  int size() const { return int(games.size()); }
+  // Starts every match over, each from its own seed
+  void reset(const uint64_t* seeds);
+  // Moves every policy paddle by its action for one step. Rewards are +1 for the step the
+  // policy scores on and -1 for the step it's scored on. A match that's done, won or played
+  // for MAX_MATCH_STEPS, has already been restarted and observed from its first step.
+  void step(const uint8_t* actions);
+
+  const AiObservations& observations() const { return observed; }
+  const GameState& game(int index) const { return games[index]; }
+  const float* rewards() const { return rewardBuffer.data(); }
+  const uint8_t* dones() const { return doneBuffer.data(); }
+
+private:
+  void startMatch(int index);
+
+  std::vector<GameState> games;
+  std::vector<long long> matchSteps;
+  AiObservations observed;
+  std::vector<float> rewardBuffer;
+  std::vector<uint8_t> doneBuffer;
+};
+
+#endif
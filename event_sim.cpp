@@ -0,0 +1,141 @@
+#include "event_sim.h"
+#include <algorithm>
+#include <math.h>
+
+// How close in pixels counts as being at an edge, so rounding can't keep an event from happening
+const Real EVENT_EPSILON = 0.001f;
+
+// Screen space velocity of the ball going down, 0 while it waits off screen to respawn
+static Real ballScreenVelY(const GameState* game) {
+  return game->ball.rect.y < 0 ? Real(0) : -game->ball.velY;
+}
+
+// How far the paddle's center is below the ball's, measured the same way as updateAi
+static Real aiDistance(const GameState* game, const Paddle* paddle) {
+  if (game->ball.rect.y < 0) return 0;
+  return (paddle->rect.y + PADDLE_HEIGHT / 2) - (game->ball.rect.y + BALL_RADIUS);
+}
+
+// True when the ball is moving away from the paddle's center
+static bool ballLeaving(Real distance, Real ballVelY) {
+  return (distance > 0 && ballVelY < 0) || (distance < 0 && ballVelY > 0);
+}
+
+// Screen space velocity the AI moves its paddle at until something changes. updateAi chases at
+// full speed outside the dead zone and stops inside it, which with time that doesn't come in
+// steps means a paddle that catches up stops right on the edge, and a ball leaving slower than
+// the paddle is trailed there at the ball's own speed.
+static Real aiScreenVelocity(const GameState* game, const Paddle* paddle, const AiSettings* settings) {
+  Real distance = aiDistance(game, paddle), ballVelY = ballScreenVelY(game);
+  Real speed = settings->speedMultiplier * PADDLE_SPEED, edge = settings->deadZone;
+  Real velocity = 0;
+  if (distance > edge + EVENT_EPSILON) {
+    velocity = -speed;
+  } else if (distance < -edge - EVENT_EPSILON) {
+    velocity = speed;
+  } else if (ballLeaving(distance, ballVelY) && fabs(distance) >= edge - EVENT_EPSILON) {
+    velocity = std::min(std::max(ballVelY, -speed), speed);
+  }
+  if ((velocity < 0 && paddle->rect.y <= EVENT_EPSILON) ||
+      (velocity > 0 && paddle->rect.y >= WINDOW_HEIGHT - PADDLE_HEIGHT - EVENT_EPSILON)) {
+    velocity = 0; // Against a wall
+  }
+  return velocity;
+}
+
+// Time until aiScreenVelocity gives something different if the ball keeps going straight
+static Real aiChangeTime(const GameState* game, const Paddle* paddle, const AiSettings* settings, Real velocity) {
+  Real distance = aiDistance(game, paddle), ballVelY = ballScreenVelY(game);
+  Real edge = settings->deadZone;
+  Real growth = velocity - ballVelY; // How fast the distance is changing
+  Real time = REAL_MAX;
+  if (velocity < 0) {
+    time = paddle->rect.y / -velocity;
+  } else if (velocity > 0) {
+    time = (WINDOW_HEIGHT - PADDLE_HEIGHT - paddle->rect.y) / velocity;
+  }
+  if (distance > edge + EVENT_EPSILON || distance < -edge - EVENT_EPSILON) {
+    // Chasing or stuck on a wall until the ball is back at the edge
+    if (distance > 0 && growth < 0) {
+      time = std::min(time, (distance - edge) / -growth);
+    } else if (distance < 0 && growth > 0) {
+      time = std::min(time, (-edge - distance) / growth);
+    }
+  } else {
+    // Resting or trailing until the ball is far enough out to be chased, which it can only do while leaving
+    Real outer = edge + EVENT_EPSILON * 2;
+    if (growth > 0) {
+      time = std::min(time, (outer - distance) / growth);
+    } else if (growth < 0) {
+      time = std::min(time, (distance + outer) / -growth);
+    }
+  }
+  return std::max(time, Real(0));
+}
+
+// Screen space velocity the predicting AI moves its paddle at, straight for its target
+static Real predictiveScreenVelocity(const Paddle* paddle, const PredictiveAi* ai) {
+  Real distance = ai->targetY - (paddle->rect.y + PADDLE_HEIGHT / 2);
+  if (fabs(distance) <= EVENT_EPSILON) {
+    return 0;
+  }
+  return distance > 0 ? PADDLE_SPEED : -PADDLE_SPEED;
+}
+
+// Time until the predicting AI reaches its target or picks a new one
+static Real predictiveChangeTime(const Paddle* paddle, const PredictiveAi* ai, Real velocity) {
+  Real time = ai->planned ? REAL_MAX : std::max(ai->reactionTime, Real(0));
+  if (velocity != 0) {
+    time = std::min(time, fabs(ai->targetY - (paddle->rect.y + PADDLE_HEIGHT / 2)) / PADDLE_SPEED);
+  }
+  return time;
+}
+
+static void moveAiPaddle(Paddle* paddle, Real velocity, Real time) {
+  paddle->velocity = -velocity; // Paddles store their velocity going up
+  paddle->rect.y = std::min(std::max(paddle->rect.y + velocity * time, Real(0)), WINDOW_HEIGHT - PADDLE_HEIGHT);
+}
+
+Real advanceToNextEvent(GameState* game, Real maxTime) {
+  Real elapsed = 0;
+  while (true) {
+    // The paddles change what they're doing many times between ball events, each change
+    // just moves everything up to it and goes around again
+    PredictiveAi* rightAi = &game->aiRightState;
+    updatePredictiveAiTarget(game, &game->paddleRight, &game->aiRight, rightAi, 0);
+    Real leftVelocity = aiScreenVelocity(game, &game->paddleLeft, &game->aiLeft);
+    Real rightVelocity = predictiveScreenVelocity(&game->paddleRight, rightAi);
+    Real time = std::min(std::min(aiChangeTime(game, &game->paddleLeft, &game->aiLeft, leftVelocity),
+      predictiveChangeTime(&game->paddleRight, rightAi, rightVelocity)), maxTime - elapsed);
+
+    bool ballEvent = false;
+    if (game->ballRespawning) {
+      ballEvent = game->ballRespawnTime <= time;
+      time = std::min(time, std::max(game->ballRespawnTime, Real(0)));
+      moveAiPaddle(&game->paddleLeft, leftVelocity, time);
+      moveAiPaddle(&game->paddleRight, rightVelocity, time);
+      game->ballRespawnTime -= time;
+      if (ballEvent) {
+        respawnBall(game);
+      }
+    } else {
+      // The same sweep stepGameplay uses finds what the ball hits, with the paddles moving along
+      game->paddleLeft.velocity = -leftVelocity; // Paddles store their velocity going up
+      game->paddleRight.velocity = -rightVelocity;
+      BallHit hit;
+      time = moveBallAndPaddles(game, time, &hit);
+      ballEvent = hit != HIT_NOTHING;
+      if (hit == HIT_SCORE) {
+        endIfWon(game);
+      }
+    }
+    if (!rightAi->planned) {
+      rightAi->reactionTime -= time;
+    }
+    elapsed += time;
+
+    if (ballEvent || elapsed >= maxTime) {
+      return elapsed;
+    }
+  }
+}
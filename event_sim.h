@@ -0,0 +1,25 @@
+#ifndef EVENT_SIM_H
+#define EVENT_SIM_H
+
+#include "game.h"
+
+// Plays AI against AI matches by jumping straight from one event to the next instead of
+// stepping 240 times a second. Between events the ball flies in a straight line, the left AI
+// paddle either rests, chases the ball at full speed, trails it at the edge of its dead zone,
+// or sits against a wall, and the right one waits to react or heads straight for its target,
+// so every position can be worked out in closed form.
+//
+// The ball moves through moveBallAndPaddles, the same sweep and hit rules stepGameplay uses,
+// with the paddles carried along. Time is continuous rather than cut into steps though, and
+// stepping can't be matched exactly: it moves the paddles a whole step before the ball and the
+// left AI overshoots into its dead zone by however far a step takes it, so where the ball meets
+// a paddle differs a little every hit and matches drift apart. Nothing here is tuned to make up
+// for that, so win rates come out close to the stepped simulation's but not the same, and a
+// match can't be checked against a replay.
+
+// Advances the match to the ball's next wall, paddle or goal event, or its respawn, or by
+// maxTime if that comes first, and returns the time that passed. Both paddles must be AI.
+// Raises soundEvents like stepGameplay and sets gameOver once somebody has won.
+Real advanceToNextEvent(GameState* game, Real maxTime);
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <stdint.h>
+#include <type_traits>
+
+// Q16.16 fixed point number. Everything is integer maths with a fixed rounding rule so results
+// are the same bit for bit on every compiler, optimization level and CPU, unlike float.
+// Numbers from about -32768 to 32768 fit, with steps of 1/65536.
+class Fixed {
+public:
+  static const int FRACTION_BITS = 16;
+  static const int32_t ONE = 1 << FRACTION_BITS;
+
+  int32_t raw = 0;
+
+  constexpr Fixed() = default;
+  // Converts any number, floats round to the nearest step
+  template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+  constexpr Fixed(T value) : raw(fromValue(value)) {}
+
+  static constexpr Fixed fromRaw(int32_t raw) {
+    Fixed fixed;
+    fixed.raw = raw;
+    return fixed;
+  }
+
+  // Rounds towards negative infinity like the integer shift it is
+  explicit constexpr operator int() const { return raw >> FRACTION_BITS; }
+  explicit constexpr operator float() const { return float(raw) / ONE; }
+
+  constexpr Fixed operator-() const { return fromRaw(-raw); }
+  Fixed& operator+=(Fixed other) { raw += other.raw; return *this; }
+  Fixed& operator-=(Fixed other) { raw -= other.raw; return *this; }
+  Fixed& operator*=(Fixed other) { *this = *this * other; return *this; }
+  Fixed& operator/=(Fixed other) { *this = *this / other; return *this; }
+
+  friend constexpr Fixed operator+(Fixed a, Fixed b) { return fromRaw(a.raw + b.raw); }
+  friend constexpr Fixed operator-(Fixed a, Fixed b) { return fromRaw(a.raw - b.raw); }
+  friend constexpr Fixed operator*(Fixed a, Fixed b) {
+    return fromRaw(int32_t((int64_t(a.raw) * b.raw) >> FRACTION_BITS));
+  }
+  // Rounds towards zero, results too big to fit saturate so times to far away hits stay huge
+  friend constexpr Fixed operator/(Fixed a, Fixed b) {
+    int64_t quotient = (int64_t(a.raw) * ONE) / b.raw;
+    return fromRaw(quotient > INT32_MAX ? INT32_MAX : quotient < -INT32_MAX ? -INT32_MAX : int32_t(quotient));
+  }
+
+  friend constexpr bool operator==(Fixed a, Fixed b) { return a.raw == b.raw; }
+  friend constexpr bool operator!=(Fixed a, Fixed b) { return a.raw != b.raw; }
+  friend constexpr bool operator<(Fixed a, Fixed b) { return a.raw < b.raw; }
+  friend constexpr bool operator>(Fixed a, Fixed b) { return a.raw > b.raw; }
+  friend constexpr bool operator<=(Fixed a, Fixed b) { return a.raw <= b.raw; }
+  friend constexpr bool operator>=(Fixed a, Fixed b) { return a.raw >= b.raw; }
+
+private:
+  template <typename T>
+  static constexpr int32_t fromValue(T value) {
+    if constexpr (std::is_floating_point<T>::value) {
+      double scaled = double(value) * ONE;
+      return int32_t(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+    } else {
+      return int32_t(value) * ONE;
+    }
+  }
+};
+
+const Fixed FIXED_MAX = Fixed::fromRaw(INT32_MAX);
+
+inline Fixed fabs(Fixed value) {
+  return value < 0 ? -value : value;
+}
+
+#endif
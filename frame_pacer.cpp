@@ -0,0 +1,56 @@
+#include "frame_pacer.h"
+#include <algorithm>
+#include <cmath>
+
+// Sleeping can overshoot by about a scheduler tick, so the end of the wait is spent spinning
+const double SPIN_MILLISECONDS = 2.0;
+
+FramePacer::FramePacer(PacingMode mode, int targetFps) : mode(mode) {
+  frequency = SDL_GetPerformanceFrequency();
+  ticksPerFrame = targetFps > 0 ? frequency / targetFps : 0;
+  lastFrame = SDL_GetPerformanceCounter();
+  nextFrame = lastFrame + ticksPerFrame;
+}
+
+float FramePacer::waitForNextFrame() {
+  if (mode == PACING_TARGET_FPS) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (now < nextFrame) {
+      double millisecondsLeft = (nextFrame - now) * 1000.0 / frequency;
+      if (millisecondsLeft > SPIN_MILLISECONDS) {
+        SDL_Delay(Uint32(millisecondsLeft - SPIN_MILLISECONDS));
+      }
+      while (SDL_GetPerformanceCounter() < nextFrame);
+      // Frames are scheduled from when they were due rather than when they started, so
+      // any time overslept is made up for on the next frame instead of drifting
+      nextFrame += ticksPerFrame;
+    } else {
+      // More than a whole frame behind, so start the schedule over instead of rushing to catch up
+      nextFrame = now + ticksPerFrame;
+    }
+  }
+
+  Uint64 now = SDL_GetPerformanceCounter();
+  double frameTime = (now - lastFrame) * 1000.0 / frequency;
+  lastFrame = now;
+
+  if (frames == 0 || frameTime < frameTimeMin) frameTimeMin = frameTime;
+  if (frames == 0 || frameTime > frameTimeMax) frameTimeMax = frameTime;
+  frameTimeSum += frameTime;
+  frameTimeSquaredSum += frameTime * frameTime;
+  ++frames;
+
+  return frameTime;
+}
+
+void FramePacer::printStats(std::ostream& out) const {
+  if (frames == 0) {
+    return;
+  }
+  double mean = frameTimeSum / frames;
+  double jitter = std::sqrt(std::max(frameTimeSquaredSum / frames - mean * mean, 0.0));
+  out << "Frames: " << frames
+      << ", average frame time: " << mean << " ms (" << 1000.0 / mean << " fps)"
+      << ", jitter: " << jitter << " ms"
+      << ", min: " << frameTimeMin << " ms, max: " << frameTimeMax << " ms\n";
+}
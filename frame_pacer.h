@@ -0,0 +1,34 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <SDL2/SDL.h>
+#include <iostream>
+
+enum PacingMode {
+  PACING_VSYNC,      // The renderer's present waits for the display
+  PACING_TARGET_FPS, // Sleep then spin until the next frame is due
+  PACING_UNCAPPED    // Never wait, for benchmarking
+};
+
+// Keeps frames at a steady rate and measures how far off that rate they actually were
+class FramePacer {
+public:
+  FramePacer(PacingMode mode, int targetFps);
+  // Waits until the next frame is due then returns the milliseconds since the last frame started
+  float waitForNextFrame();
+  void printStats(std::ostream& out) const;
+
+private:
+  PacingMode mode;
+  Uint64 frequency;
+  Uint64 ticksPerFrame;
+  Uint64 nextFrame;
+  Uint64 lastFrame;
+
+  // Running frame time statistics in milliseconds
+  long long frames = 0;
+  double frameTimeSum = 0.0, frameTimeSquaredSum = 0.0;
+  double frameTimeMin = 0.0, frameTimeMax = 0.0;
+};
+
+#endif
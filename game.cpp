@@ -0,0 +1,469 @@
+#include "game.h"
+#include <string.h>
+#include <algorithm>
+#include <tgmath.h>
+#include "trig.h"
+
+#ifndef PONG_LIBM_TRIG
+// Serves and bounces only ever need sin and cos of a few curves, so their results are worked out
+// by the compiler once instead of on every hit. Compared to calling libm with doubles, serves
+// are off by no more than float rounding (0.00000003) and bounce velocities by at most
+// 0.000006 * BALL_SPEED. Fixed point builds are limited by Q16.16's steps to 0.000008 for
+// serves and 0.000034 * BALL_SPEED for bounces, measured at every offset a hit can give.
+
+const int SERVE_MAX_DEGREES = 45;
+const int BOUNCE_TABLE_STEPS = 1024;
+// The ball can touch the paddle up to its radius past either end, so normalized hit offsets
+// reach 1 + 2 * BALL_RADIUS / PADDLE_HEIGHT = 9/7, this covers that with room to spare
+const double BOUNCE_TABLE_RANGE = 1.5;
+#ifdef PONG_FIXED_POINT
+// Q16.16 multiplies round down, so entries sit half a step high to centre the interpolation's error
+const double BOUNCE_TABLE_BIAS = 0.5 / Fixed::ONE;
+#else
+const double BOUNCE_TABLE_BIAS = 0.0;
+#endif
+
+struct TrigTables {
+  // cos and sin of every whole serve angle from -45 to 45 degrees
+  Real serveCos[SERVE_MAX_DEGREES * 2 + 1], serveSin[SERVE_MAX_DEGREES * 2 + 1];
+  // Ball velocity for a hit at a normalized offset from -BOUNCE_TABLE_RANGE to
+  // BOUNCE_TABLE_RANGE, x is for a hit off the left paddle. BALL_SPEED is already in it
+  // so fixed point builds don't round a second time multiplying by it.
+  Real bounceX[BOUNCE_TABLE_STEPS + 1], bounceY[BOUNCE_TABLE_STEPS + 1];
+};
+
+constexpr TrigTables makeTrigTables() {
+  const double pi = 3.14159265358979323846;
+  TrigTables tables {};
+  for (int i = 0; i <= SERVE_MAX_DEGREES * 2; ++i) {
+    double angle = (i - SERVE_MAX_DEGREES) * pi / 180;
+    tables.serveCos[i] = taylorCos(angle);
+    tables.serveSin[i] = taylorSin(angle);
+  }
+  // Same curves as the libm path in paddleHitBall
+  const double ballSpeed = double(float(BALL_SPEED));
+  for (int i = 0; i <= BOUNCE_TABLE_STEPS; ++i) {
+    double normalized = BOUNCE_TABLE_RANGE * (2.0 * i / BOUNCE_TABLE_STEPS - 1);
+    double angle = normalized * 45 * pi / 180;
+    double speedMultiplier = 0.5 * taylorSin(3 * normalized - pi / 2) + 1.2;
+    tables.bounceX[i] = speedMultiplier * ballSpeed * taylorCos(angle) + BOUNCE_TABLE_BIAS;
+    tables.bounceY[i] = speedMultiplier * ballSpeed * taylorSin(angle) + BOUNCE_TABLE_BIAS;
+  }
+  return tables;
+}
+
+constexpr TrigTables TRIG_TABLES = makeTrigTables();
+
+// Linear interpolation between the two entries either side of the normalized offset
+static Real lookupBounce(const Real* table, Real normalized) {
+  Real position = (std::min(std::max(normalized, Real(-BOUNCE_TABLE_RANGE)), Real(BOUNCE_TABLE_RANGE)) +
+    Real(BOUNCE_TABLE_RANGE)) * Real(BOUNCE_TABLE_STEPS / (2 * BOUNCE_TABLE_RANGE));
+  int index = std::min(int(position), BOUNCE_TABLE_STEPS - 1);
+  Real fraction = position - Real(index);
+  return table[index] + (table[index + 1] - table[index]) * fraction;
+}
+#endif
+
+void initGame(GameState* game, uint64_t seed) {
+  game->tick = 0;
+  seedRandom(&game->rng, seed);
+  game->paddleLeft.rect.x = PADDLE_SPACING_FROM_EDGE;
+  game->paddleRight.rect.x = WINDOW_WIDTH - PADDLE_SPACING_FROM_EDGE - PADDLE_WIDTH;
+  game->leftSideServing = randomBelow(&game->rng, 2); // Random initial serve
+  respawnBall(game);
+}
+
+static void updatePaddlePosition(Paddle* paddle, Real delta_time) {
+    paddle->rect.y -= 
+      paddle->velocity * delta_time;
+    if (paddle->rect.y > WINDOW_HEIGHT - PADDLE_HEIGHT) {
+      paddle->rect.y = WINDOW_HEIGHT - PADDLE_HEIGHT;
+    } else if (paddle->rect.y < 0) {
+      paddle->rect.y = 0;
+    }
+}
+
+// Returns the time the moving ball first touches the rect, 0 if they already overlap,
+// or a negative number if they don't touch within maxTime
+static Real sweepBall(const Rect& ballRect, Real velX, Real velY, const Rect& rect, Real maxTime) {
+  // Grow the rect by the ball's size so the ball can be treated as a point moving through it
+  Real minX = rect.x - ballRect.w, maxX = rect.x + rect.w;
+  Real minY = rect.y - ballRect.h, maxY = rect.y + rect.h;
+  Real entry = -REAL_MAX, exit = REAL_MAX;
+  if (velX == 0.0f) {
+    if (ballRect.x <= minX || ballRect.x >= maxX) return -1.0f;
+  } else {
+    Real t1 = (minX - ballRect.x) / velX, t2 = (maxX - ballRect.x) / velX;
+    entry = std::max(entry, std::min(t1, t2));
+    exit = std::min(exit, std::max(t1, t2));
+  }
+  if (velY == 0.0f) {
+    if (ballRect.y <= minY || ballRect.y >= maxY) return -1.0f;
+  } else {
+    Real t1 = (minY - ballRect.y) / velY, t2 = (maxY - ballRect.y) / velY;
+    entry = std::max(entry, std::min(t1, t2));
+    exit = std::min(exit, std::max(t1, t2));
+  }
+  if (entry >= exit || exit <= 0.0f || entry > maxTime) return -1.0f;
+  return std::max(entry, Real(0));
+}
+
+// Respawns the ball at a random point with random velocity on the net after 3 seconds
+void respawnBall(GameState* game) {
+  game->ballTeleported = true;
+  ++game->ballLaunches;
+  // Set the ball off screen and set the ball respawn timer
+  if (!game->ballRespawning) {
+    game->ball.velX = 0;
+    game->ball.velY = 0;
+    game->ball.rect.x = -50;
+    game->ball.rect.y = -50;
+    game->ballRespawnTime = 3000;
+    game->ballRespawning = true;
+  } else { // Spawn in the ball
+    game->ballRespawning = false;
+    int degrees = int(randomBelow(&game->rng, 90)) - 45; // -45 deg. to 45 deg. (prevents vertical start)
+#ifdef PONG_LIBM_TRIG
+    Real angle = Real(degrees) * PI / 180.0f;
+    game->ball.velX = cos(angle) * BALL_SPEED * (game->leftSideServing ? 1 : -1);
+    game->ball.velY = sin(angle) * BALL_SPEED;
+#else
+    game->ball.velX = TRIG_TABLES.serveCos[degrees + SERVE_MAX_DEGREES] * BALL_SPEED * (game->leftSideServing ? 1 : -1);
+    game->ball.velY = TRIG_TABLES.serveSin[degrees + SERVE_MAX_DEGREES] * BALL_SPEED;
+#endif
+    game->ball.rect.x = WINDOW_WIDTH / 2.0f - BALL_RADIUS;
+    game->ball.rect.y = randomBelow(&game->rng, int(WINDOW_HEIGHT - BALL_RADIUS * 2)) + BALL_RADIUS * 2.0f;
+  }
+}
+
+// Adjust ball velocity if it hits a paddle
+void paddleHitBall(GameState* game, bool leftPaddle) {
+  ++game->ballLaunches;
+  // How far from center of the paddle is the middle of the ball
+  Real relativeBallPaddle = 
+    ((leftPaddle ? game->paddleLeft.rect.y : game->paddleRight.rect.y) + PADDLE_HEIGHT / 2)
+    - (game->ball.rect.y + BALL_RADIUS);
+  // Either edge of paddle is 1, middle of paddle is 0
+  Real normalizedBallPaddle = relativeBallPaddle / (PADDLE_HEIGHT / 2);
+#ifdef PONG_LIBM_TRIG
+  Real angle = normalizedBallPaddle * 45 * PI / 180.0f; // 75 deg is the max angle we want
+  // Ball goes faster if hit on edge, slower if in center
+  Real speedMultiplier = 0.5 * sin(3 * normalizedBallPaddle - PI / 2) + 1.2;
+  game->ball.velX = speedMultiplier * BALL_SPEED * cos(angle) * (leftPaddle ? 1 : -1);
+  game->ball.velY = speedMultiplier * BALL_SPEED * sin(angle);
+#else
+  // The same angle and speed as above looked up from the table
+  Real velX = lookupBounce(TRIG_TABLES.bounceX, normalizedBallPaddle);
+  game->ball.velX = leftPaddle ? velX : -velX;
+  game->ball.velY = lookupBounce(TRIG_TABLES.bounceY, normalizedBallPaddle);
+#endif
+}
+
+// Moves the ball up to the first paddle or edge of the screen it hits within maxTime, finding
+// the exact time so it can't pass through anything no matter how fast it's going, then plays
+// out the hit and returns the time that took. Paddles are only solid while playing and the ball
+// bounces off every edge when not playing. Stepping has already moved the paddles for the step,
+// with paddlesMoving they go along with the ball at their velocities instead.
+static Real moveBallToHit(GameState* game, Real maxTime, bool playing, bool paddlesMoving, BallHit* result) {
+  const Real ballSize = BALL_RADIUS * 2;
+  // Screen space velocities, the ball and paddles store theirs positive going up
+  Real velX = game->ball.velX, velY = -game->ball.velY;
+  Real leftVelY = paddlesMoving ? -game->paddleLeft.velocity : Real(0);
+  Real rightVelY = paddlesMoving ? -game->paddleRight.velocity : Real(0);
+
+  // Find whatever the ball hits first
+  enum { NOTHING, PADDLE_LEFT, PADDLE_RIGHT, WALL, EDGE_LEFT, EDGE_RIGHT } hit = NOTHING;
+  Real hitTime = maxTime;
+  if (velY < 0.0f) {
+    Real t = std::max(-game->ball.rect.y / velY, Real(0));
+    if (t <= hitTime) { hit = WALL; hitTime = t; }
+  } else if (velY > 0.0f) {
+    Real t = std::max((WINDOW_HEIGHT - ballSize - game->ball.rect.y) / velY, Real(0));
+    if (t <= hitTime) { hit = WALL; hitTime = t; }
+  }
+  if (velX < 0.0f) {
+    Real t = std::max(-game->ball.rect.x / velX, Real(0));
+    if (t < hitTime) { hit = EDGE_LEFT; hitTime = t; }
+  } else if (velX > 0.0f) {
+    Real t = std::max((WINDOW_WIDTH - ballSize - game->ball.rect.x) / velX, Real(0));
+    if (t < hitTime) { hit = EDGE_RIGHT; hitTime = t; }
+  }
+  // A paddle only counts when the ball is heading towards the middle of the screen
+  // from its side, otherwise it was just hit and is still on its way out
+  if (playing && velX < 0.0f) {
+    Real t = sweepBall(game->ball.rect, velX, velY - leftVelY, game->paddleLeft.rect, hitTime);
+    if (t >= 0.0f && t <= hitTime) { hit = PADDLE_LEFT; hitTime = t; }
+  } else if (playing && velX > 0.0f) {
+    Real t = sweepBall(game->ball.rect, velX, velY - rightVelY, game->paddleRight.rect, hitTime);
+    if (t >= 0.0f && t <= hitTime) { hit = PADDLE_RIGHT; hitTime = t; }
+  }
+
+  game->ball.rect.x += velX * hitTime;
+  game->ball.rect.y += velY * hitTime;
+  if (paddlesMoving) {
+    updatePaddlePosition(&game->paddleLeft, hitTime);
+    updatePaddlePosition(&game->paddleRight, hitTime);
+  }
+
+  *result = HIT_BOUNCE;
+  switch (hit) {
+    case NOTHING:
+      *result = HIT_NOTHING;
+      break;
+    case PADDLE_LEFT:
+    case PADDLE_RIGHT:
+      game->soundEvents |= SOUND_PADDLE;
+      paddleHitBall(game, hit == PADDLE_LEFT);
+      break;
+    case WALL:
+      if (playing) game->soundEvents |= SOUND_WALL;
+      game->ball.velY *= -1;
+      break;
+    case EDGE_LEFT:
+    case EDGE_RIGHT:
+      if (playing) {
+        scorePoint(game, hit == EDGE_RIGHT);
+        *result = HIT_SCORE;
+        break;
+      }
+      game->ball.velX *= -1;
+      break;
+  }
+  return hitTime;
+}
+
+// Moves the ball through the step, bouncing off everything it hits on the way
+static void moveBall(GameState* game, Real delta_time, bool playing) {
+  const int maxBounces = 8; // Only reachable when the ball is wedged somewhere
+  Real timeLeft = delta_time;
+  for (int bounce = 0; bounce < maxBounces && timeLeft > 0.0f; ++bounce) {
+    BallHit hit;
+    timeLeft -= moveBallToHit(game, timeLeft, playing, false, &hit);
+    if (hit != HIT_BOUNCE) return;
+  }
+}
+
+Real moveBallAndPaddles(GameState* game, Real maxTime, BallHit* hit) {
+  return moveBallToHit(game, maxTime, true, true, hit);
+}
+
+void scorePoint(GameState* game, bool leftScored) {
+  ++(leftScored ? game->paddleLeft : game->paddleRight).score;
+  game->soundEvents |= SOUND_SCORE;
+  game->leftSideServing = leftScored;
+  respawnBall(game);
+}
+
+bool endIfWon(GameState* game) {
+  if (game->paddleLeft.score >= WINNING_SCORE || game->paddleRight.score >= WINNING_SCORE) {
+    game->ballRespawning = true;
+    respawnBall(game);
+    game->gameOver = true;
+    return true;
+  }
+  return false;
+}
+
+void restartGame(GameState* game) {
+  game->paddleLeft.score = 0;
+  game->paddleLeft.rect.y = PADDLE_SPAWN_Y;
+  game->paddleRight.score = 0;
+  game->paddleRight.rect.y = PADDLE_SPAWN_Y;
+  game->leftSideServing = randomBelow(&game->rng, 2); // Random initial serve
+  game->ballRespawning = false;
+  game->player2Ai = true;
+  game->gameOver = false;
+  respawnBall(game);
+}
+
+void updateAi(const GameState* game, Paddle* paddle, const AiSettings* settings) {
+  Real paddleBallVertDist = (paddle->rect.y + PADDLE_HEIGHT / 2) - (game->ball.rect.y + BALL_RADIUS);
+  if (game->ball.rect.y < 0) paddleBallVertDist = 0.0f;
+  if (fabs(paddleBallVertDist) > settings->deadZone) {
+    paddle->velocity = settings->speedMultiplier * (paddleBallVertDist > 1 ? PADDLE_SPEED : -PADDLE_SPEED);
+  } else {
+    paddle->velocity = 0.0f;
+  }
+}
+
+Real interceptY(const GameState* game, const Paddle* paddle) {
+  const Rect& ball = game->ball.rect;
+  bool leftPaddle = paddle->rect.x < WINDOW_WIDTH / 2;
+  Real frontX = leftPaddle ? paddle->rect.x + paddle->rect.w : paddle->rect.x - ball.w;
+  Real time = (frontX - ball.x) / game->ball.velX;
+  // Where it would be with no walls, then mirrored back in off each wall it passes
+  Real lowest = WINDOW_HEIGHT - ball.h;
+  Real y = ball.y - game->ball.velY * time;
+  while (y < 0 || y > lowest) {
+    y = y < 0 ? -y : lowest * 2 - y;
+  }
+  return y + BALL_RADIUS;
+}
+
+void updatePredictiveAiTarget(GameState* game, const Paddle* paddle, const PredictiveAiSettings* settings,
+    PredictiveAi* ai, Real delta_time) {
+  if (ai->launchesSeen != game->ballLaunches) {
+    ai->launchesSeen = game->ballLaunches;
+    ai->reactionTime = settings->reactionDelay;
+    ai->planned = false;
+  }
+  if (ai->planned) {
+    return;
+  }
+  ai->reactionTime -= delta_time;
+  if (ai->reactionTime > 0) {
+    return;
+  }
+  ai->planned = true;
+  bool leftPaddle = paddle->rect.x < WINDOW_WIDTH / 2;
+  bool incoming = !game->ballRespawning && (leftPaddle ? game->ball.velX < 0 : game->ball.velX > 0);
+  if (!incoming) {
+    ai->targetY = WINDOW_HEIGHT / 2.0f;
+    return;
+  }
+  int maxError = std::max(0, int(settings->aimError)); // Negative would wrap randomBelow's bound
+  Real error = int(randomBelow(&game->rng, maxError * 2 + 1)) - maxError;
+  ai->targetY = std::min(std::max(interceptY(game, paddle) + error, PADDLE_HEIGHT / 2),
+    WINDOW_HEIGHT - PADDLE_HEIGHT / 2);
+}
+
+void updatePredictiveAi(GameState* game, Paddle* paddle, const PredictiveAiSettings* settings,
+    PredictiveAi* ai, Real delta_time) {
+  updatePredictiveAiTarget(game, paddle, settings, ai, delta_time);
+  // Velocity is positive going up, the last bit of the way is slower so it lands on the target
+  Real distance = (paddle->rect.y + PADDLE_HEIGHT / 2) - ai->targetY;
+  if (fabs(distance) > PADDLE_SPEED * delta_time) {
+    paddle->velocity = distance > 0 ? PADDLE_SPEED : -PADDLE_SPEED;
+  } else {
+    paddle->velocity = delta_time > 0 ? distance / delta_time : Real(0);
+  }
+}
+
+void beginGameplayStep(GameState* game, Real delta_time) {
+  if (game->ballRespawning) {
+    game->ballRespawnTime -= delta_time;
+    if (game->ballRespawnTime < 0) {
+      respawnBall(game);
+    }
+  }
+}
+
+bool stepGameplay(GameState* game, Real delta_time) {
+  beginGameplayStep(game, delta_time);
+  return finishGameplayStep(game, delta_time);
+}
+
+bool finishGameplayStep(GameState* game, Real delta_time) {
+  if (game->player1Ai) updateAi(game, &game->paddleLeft, &game->aiLeft);
+  updatePaddlePosition(&game->paddleLeft, delta_time);
+  if (game->player2Ai) updatePredictiveAi(game, &game->paddleRight, &game->aiRight, &game->aiRightState, delta_time);
+  updatePaddlePosition(&game->paddleRight, delta_time);
+  if (!game->ballRespawning) {
+    moveBall(game, delta_time, true);
+  }
+  return endIfWon(game);
+}
+
+void stepGameOver(GameState* game, Real delta_time) {
+  moveBall(game, delta_time, false);
+}
+
+// Paddle speed for the direction held in the input bits
+static Real inputVelocity(uint8_t input, uint8_t upBit, uint8_t downBit) {
+  if (input & upBit) return PADDLE_SPEED;
+  if (input & downBit) return -PADDLE_SPEED;
+  return 0.0f;
+}
+
+static void applyInput(GameState* game, uint8_t input) {
+  if (input & INPUT_RESTART) {
+    restartGame(game);
+  }
+  if (game->gameOver) {
+    return;
+  }
+  if (input & INPUT_TOGGLE_AI) {
+    game->player2Ai = !game->player2Ai;
+    game->paddleRight.velocity = 0.0f;
+  }
+  game->paddleLeft.velocity = inputVelocity(input, INPUT_LEFT_UP, INPUT_LEFT_DOWN);
+  if (!game->player2Ai) {
+    game->paddleRight.velocity = inputVelocity(input, INPUT_RIGHT_UP, INPUT_RIGHT_DOWN);
+  }
+}
+
+void stepHeldPaddle(Paddle* paddle, uint8_t paddleInput, Real delta_time) {
+  paddle->velocity = inputVelocity(paddleInput, INPUT_LEFT_UP, INPUT_LEFT_DOWN);
+  updatePaddlePosition(paddle, delta_time);
+}
+
+void stepGame(GameState* game, uint8_t input, Real delta_time) {
+  applyInput(game, input);
+  if (!game->gameOver) {
+    stepGameplay(game, delta_time);
+  } else {
+    stepGameOver(game, delta_time);
+  }
+  ++game->tick;
+}
+
+// FNV-1a a word at a time instead of a byte at a time since it's run every step
+static void hashWord(uint32_t* hash, uint32_t word) {
+  *hash = (*hash ^ word) * 16777619u;
+}
+
+// Numbers are hashed by their bits so even the smallest difference shows up
+static void hashReal(uint32_t* hash, Real value) {
+  static_assert(sizeof(Real) == sizeof(uint32_t), "Real must hash as one word");
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  hashWord(hash, bits);
+}
+
+static void hashRect(uint32_t* hash, const Rect& rect) {
+  hashReal(hash, rect.x);
+  hashReal(hash, rect.y);
+  hashReal(hash, rect.w);
+  hashReal(hash, rect.h);
+}
+
+static void hashPaddle(uint32_t* hash, const Paddle& paddle) {
+  hashRect(hash, paddle.rect);
+  hashReal(hash, paddle.velocity);
+  hashWord(hash, paddle.score);
+}
+
+static void hashAiSettings(uint32_t* hash, const AiSettings& settings) {
+  hashReal(hash, settings.speedMultiplier);
+  hashReal(hash, settings.deadZone);
+}
+
+static void hashPredictiveAi(uint32_t* hash, const PredictiveAiSettings& settings, const PredictiveAi& ai) {
+  hashReal(hash, settings.reactionDelay);
+  hashReal(hash, settings.aimError);
+  hashWord(hash, ai.launchesSeen);
+  hashReal(hash, ai.reactionTime);
+  hashWord(hash, ai.planned);
+  hashReal(hash, ai.targetY);
+}
+
+uint32_t hashGameState(const GameState* game) {
+  uint32_t hash = 2166136261u;
+  hashWord(&hash, game->tick);
+  hashPaddle(&hash, game->paddleLeft);
+  hashPaddle(&hash, game->paddleRight);
+  hashRect(&hash, game->ball.rect);
+  hashReal(&hash, game->ball.velX);
+  hashReal(&hash, game->ball.velY);
+  hashWord(&hash, game->leftSideServing | game->ballRespawning << 1 | game->player1Ai << 2 |
+    game->player2Ai << 3 | game->gameOver << 4);
+  hashReal(&hash, game->ballRespawnTime);
+  hashAiSettings(&hash, game->aiLeft);
+  hashPredictiveAi(&hash, game->aiRight, game->aiRightState);
+  hashWord(&hash, game->ballLaunches);
+  hashWord(&hash, uint32_t(game->rng.state));
+  hashWord(&hash, uint32_t(game->rng.state >> 32));
+  hashWord(&hash, uint32_t(game->rng.increment));
+  hashWord(&hash, uint32_t(game->rng.increment >> 32));
+  return hash;
+}
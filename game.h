@@ -0,0 +1,184 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include <limits>
+#include <type_traits>
+#include "rng.h"
+#ifdef PONG_FIXED_POINT
+#include "fixed.h"
+#include "trig.h"
+#endif
+
+// The rules of the game, kept free of SDL so matches can be simulated without a window or audio
+
+// Every number the simulation works with. Building with PONG_FIXED_POINT swaps float for Q16.16
+// fixed point so matches play out bit for bit the same whatever compiler or flags built them.
+#ifdef PONG_FIXED_POINT
+typedef Fixed Real;
+const Real REAL_MAX = FIXED_MAX;
+#else
+typedef float Real;
+const Real REAL_MAX = std::numeric_limits<float>::infinity();
+#endif
+
+// How the simulation was built, stored in replays so they're only played by a matching build.
+// Bounce and serve directions come from tables made at compile time unless PONG_LIBM_TRIG asks
+// for sin and cos to be called on every hit like the original game did.
+enum SimulationFlags {
+  SIMULATION_FIXED_POINT = 1,
+  SIMULATION_LIBM_TRIG = 2
+};
+
+const uint8_t SIMULATION_FLAGS = 0
+#ifdef PONG_FIXED_POINT
+  | SIMULATION_FIXED_POINT
+#endif
+#ifdef PONG_LIBM_TRIG
+  | SIMULATION_LIBM_TRIG
+#endif
+  ;
+
+#define PI 3.14159265
+
+const int WINDOW_WIDTH = 904, WINDOW_HEIGHT = 800;
+const Real PADDLE_SPACING_FROM_EDGE = 45.0f;
+const Real PADDLE_HEIGHT = WINDOW_HEIGHT * 0.07f, PADDLE_WIDTH = WINDOW_WIDTH * 0.01f;
+const Real PADDLE_SPEED = 0.7f;
+const Real BALL_RADIUS = WINDOW_HEIGHT * 0.01f;
+constexpr Real BALL_SPEED = 0.5f; // constexpr so the bounce tables can be built already scaled by it
+const Real PADDLE_SPAWN_Y = WINDOW_HEIGHT / 2.0f - PADDLE_HEIGHT / 2.0f;
+const int STEPS_PER_SECOND = 240;
+const float SIMULATION_STEP = 1000.0f / STEPS_PER_SECOND; // Milliseconds simulated per step
+const int WINNING_SCORE = 11;
+const long long MAX_MATCH_STEPS = 240LL * 60 * 10; // Ten minutes of play before a match is abandoned
+
+// Sounds the simulation wants played, combined as bit flags in soundEvents
+enum GameSound {
+  SOUND_PADDLE = 1,
+  SOUND_WALL = 2,
+  SOUND_SCORE = 4
+};
+
+// What the players asked for during one step, packed into a byte so it's cheap to record.
+// Paddle bits hold the direction a paddle should move, the rest are one off actions.
+enum InputBits {
+  INPUT_LEFT_UP = 1,
+  INPUT_LEFT_DOWN = 2,
+  INPUT_RIGHT_UP = 4,
+  INPUT_RIGHT_DOWN = 8,
+  INPUT_RESTART = 16,
+  INPUT_TOGGLE_AI = 32,
+  INPUT_LEFT_MASK = INPUT_LEFT_UP | INPUT_LEFT_DOWN,
+  INPUT_RIGHT_MASK = INPUT_RIGHT_UP | INPUT_RIGHT_DOWN
+};
+
+// Same layout as SDL_FRect when Real is float
+struct Rect {
+  Real x, y, w, h;
+};
+
+struct Paddle {
+  Rect rect {0.0f, PADDLE_SPAWN_Y, PADDLE_WIDTH, PADDLE_HEIGHT};
+  Real velocity = 0.0f;
+  int score = 0;
+};
+
+struct Ball {
+  Rect rect {
+    WINDOW_WIDTH / 2.0f - BALL_RADIUS,
+    WINDOW_HEIGHT / 2.0f - BALL_RADIUS,
+    BALL_RADIUS * 2.0f, BALL_RADIUS * 2.0f
+  };
+  Real velX = 0.0f, velY = 0.0f;
+};
+
+// How the AI chases the ball
+struct AiSettings {
+  Real speedMultiplier = 0.7f; // Fraction of PADDLE_SPEED the AI moves at
+  Real deadZone = 3.0f; // How far off center the ball can be before the AI moves
+};
+
+// How the predicting AI plays, it always moves at full PADDLE_SPEED so these set how good it is
+struct PredictiveAiSettings {
+  Real reactionDelay = 200.0f; // Milliseconds after a serve or hit before it works out where to go
+  Real aimError = 44.0f; // Most pixels its guess of where the ball arrives can be off either way
+};
+
+// What the predicting AI has worked out. It only looks at the ball once per serve or hit and
+// heads for where the ball will cross its paddle, or the middle while the ball is going away.
+struct PredictiveAi {
+  uint32_t launchesSeen = 0; // ballLaunches when it last started reacting
+  Real reactionTime = 0.0f; // Milliseconds left before it picks a target
+  bool planned = false; // Whether targetY is for the latest launch
+  Real targetY = WINDOW_HEIGHT / 2.0f; // Where it's taking the paddle's center
+};
+
+// Everything about one match. It holds no pointers or resources so it can be copied to
+// snapshot a match, and any number of matches can be stepped independently.
+struct GameState {
+  Paddle paddleLeft, paddleRight;
+  Ball ball;
+  bool leftSideServing = false;
+  bool ballRespawning = false;
+  bool ballTeleported = false; // Set when the ball jumps somewhere so it isn't interpolated
+  Real ballRespawnTime = 0.0f; // This keeps track of the time when the ball will respawn
+  bool player1Ai = false, player2Ai = true;
+  AiSettings aiLeft; // The left AI chases the ball
+  PredictiveAiSettings aiRight; // The right AI predicts where the ball is going
+  PredictiveAi aiRightState;
+  uint32_t ballLaunches = 0; // Serves and paddle hits so far, the ball's path only changes then and off walls
+  bool gameOver = false;
+  int soundEvents = 0; // GameSound flags raised since the front end last cleared them
+  uint32_t tick = 0; // Steps taken since initGame
+  Rng rng;
+};
+
+static_assert(std::is_trivially_copyable<GameState>::value, "GameState must be copyable with memcpy");
+
+// Puts the paddles in place and serves the first ball, the seed decides every serve
+void initGame(GameState* game, uint64_t seed);
+// Resets scores, serve, ball, and AI
+void restartGame(GameState* game);
+void respawnBall(GameState* game);
+// Sends the ball back off a paddle, steeper and faster the further from the center it hit
+void paddleHitBall(GameState* game, bool leftPaddle);
+// Gives the point to a side and serves the next ball towards the side that lost it
+void scorePoint(GameState* game, bool leftScored);
+// Starts the game over screen once somebody has enough points, returns true if it did
+bool endIfWon(GameState* game);
+// What the ball ran into, a bounce is off a wall or paddle and a score is off a goal line
+enum BallHit { HIT_NOTHING, HIT_BOUNCE, HIT_SCORE };
+// Moves the ball and both paddles together for up to maxTime, the paddles at their velocities,
+// stopping right after the ball's first hit which is played out like stepGameplay would. Returns
+// the time that passed. The paddles stop at the walls but the ball won't see them stop.
+Real moveBallAndPaddles(GameState* game, Real maxTime, BallHit* hit);
+// Moves the paddle towards the ball when it's AI controlled
+void updateAi(const GameState* game, Paddle* paddle, const AiSettings* settings);
+// Where the ball's center will be when it reaches the paddle's front, with the wall bounces
+// on the way folded in. Only meaningful while the ball is heading towards the paddle.
+Real interceptY(const GameState* game, const Paddle* paddle);
+// Counts down the reaction delay after every serve or hit, then picks the paddle's target
+// using the match's random numbers for the aim error
+void updatePredictiveAiTarget(GameState* game, const Paddle* paddle, const PredictiveAiSettings* settings,
+  PredictiveAi* ai, Real delta_time);
+// Picks the target when it's time to then heads for it at full speed, stopping right on it
+void updatePredictiveAi(GameState* game, Paddle* paddle, const PredictiveAiSettings* settings,
+  PredictiveAi* ai, Real delta_time);
+// Advances gameplay by one step, returns true once somebody has won
+bool stepGameplay(GameState* game, Real delta_time);
+// stepGameplay in two halves, the ball is served in the first and AI controllers that set
+// paddle velocities themselves decide in between so they see what the built in AIs would
+void beginGameplayStep(GameState* game, Real delta_time);
+bool finishGameplayStep(GameState* game, Real delta_time);
+// Advances the game over screen where the ball bounces around by itself
+void stepGameOver(GameState* game, Real delta_time);
+// Applies the players' input then advances gameplay or the game over screen by one step
+void stepGame(GameState* game, uint8_t input, Real delta_time);
+// Moves one paddle a step the way stepGame would for its input, INPUT_LEFT_UP or INPUT_LEFT_DOWN
+// whichever side it's on, so a player can see their paddle move before the server has played it
+void stepHeldPaddle(Paddle* paddle, uint8_t paddleInput, Real delta_time);
+// Hashes everything that decides how the match plays out, two matches with the same hash on
+// the same tick are almost certainly identical. Front end flags like soundEvents aren't included.
+uint32_t hashGameState(const GameState* game);
+
+#endif
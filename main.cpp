@@ -5,216 +5,613 @@
 #include <string>
 #include <time.h>
 #include <chrono>
+#include <memory>
 #include <algorithm>
 #include <tgmath.h>
+#include "frame_pacer.h"
+#include "game.h"
+#include "event_sim.h"
+#include "render_queue.h"
+#include "replay.h"
+#include "env.h"
+#include "shared_buffers.h"
+#include "net.h"
+#include "rollback.h"
+#include "server_client.h"
 
-#define PI 3.14159265
-
-const int WINDOW_WIDTH = 904, WINDOW_HEIGHT = 800;
 const char* SCORE_FONT_LOCATION = "./src/fonts/pong-score.ttf";
 const char* SFX_PADDLE_LOCATION = "./src/sfx/pong-paddle.wav";
 const char* SFX_SCORE_LOCATION = "./src/sfx/pong-score.wav";
 const char* SFX_WALL_LOCATION = "./src/sfx/pong-wall.wav";
-const float PADDLE_SPACING_FROM_EDGE = 45.0f;
-const float PADDLE_HEIGHT = WINDOW_HEIGHT * 0.07f, PADDLE_WIDTH = WINDOW_WIDTH * 0.01f;
-const float PADDLE_SPEED = 0.7f;
-const float BALL_RADIUS = WINDOW_HEIGHT * 0.01f;
-const float BALL_SPEED = 0.5f;
-const float PADDLE_SPAWN_Y = WINDOW_HEIGHT / 2.0f - PADDLE_HEIGHT / 2.0f;
+const int MAX_STEPS_PER_FRAME = 12; // Any more time than this per frame is dropped to avoid spiraling
+const int DEFAULT_TARGET_FPS = 60;
+const int DEFAULT_HEADLESS_MATCHES = 1000;
+const long long NET_TEST_STEPS = 240LL * 60 * 2; // Two minutes of play
 
 SDL_Window* window;
 SDL_Renderer* renderer;
-SDL_Event event;
+RenderQueue renderQueue;
 TTF_Font* scoreFont;
 Mix_Chunk* soundHitPaddle;
 Mix_Chunk* soundScore;
 Mix_Chunk* soundHitWall;
-bool leftSideServing;
-bool ballRespawning = false;
-float ballRespawnTime = 0.0f; // This keeps track of the time when the ball will respawn
-bool player2Ai = true;
-
-struct Paddle {
-  SDL_FRect rect {0.0f, PADDLE_SPAWN_Y, PADDLE_WIDTH, PADDLE_HEIGHT};
-  float velocity = 0.0f;
-  int score = 0;
-} paddleLeft, paddleRight;
-
-struct Ball {
-  SDL_FRect rect {
-    WINDOW_WIDTH / 2.0f - BALL_RADIUS,
-    WINDOW_HEIGHT / 2.0f - BALL_RADIUS,
-    BALL_RADIUS * 2.0f, BALL_RADIUS * 2.0f
-  };
-  float velX = 0.0f, velY = 0.0f;
-} ball;
+bool showRenderStats = false;
+const SDL_Color WHITE {255, 255, 255, 255};
 
-// Draws the background, net paddles, ball, and scores
-void drawGame(bool renderPaddles) {
-  // Draw the black screen
+// The digits 0-9 pre-rendered side by side into a single texture
+struct DigitAtlas {
+  SDL_Texture* texture = NULL;
+  SDL_Rect digits[10];
+} digitAtlas;
+
+// The black screen and net, drawn once into a target texture and copied every frame
+struct BackgroundLayer {
+  SDL_Texture* texture = NULL;
+  bool dirty = true; // Set when the texture has to be redrawn
+  bool unsupported = false; // Set once creating the texture failed, the background is then drawn every frame
+} backgroundLayer;
+
+// Renders the digits 0-9 from the font once so numbers never need to be rasterized again
+bool createDigitAtlas(DigitAtlas* atlas, TTF_Font* font) {
+  const char* digitText = "0123456789";
+  SDL_Surface* atlasSurface = TTF_RenderText_Solid(font, digitText, {255, 255, 255, 255});
+  if (!atlasSurface) {
+    return false;
+  }
+  // Measure each prefix of the string so kerning between digits is accounted for
+  int prefixWidth = 0;
+  for (int digit = 0; digit < 10; ++digit) {
+    std::string prefix(digitText, digit + 1);
+    int width, height;
+    TTF_SizeText(font, prefix.c_str(), &width, &height);
+    atlas->digits[digit] = {prefixWidth, 0, width - prefixWidth, atlasSurface->h};
+    prefixWidth = width;
+  }
+  atlas->texture = SDL_CreateTextureFromSurface(renderer, atlasSurface);
+  SDL_FreeSurface(atlasSurface);
+  return atlas->texture != NULL;
+}
+
+void destroyDigitAtlas(DigitAtlas* atlas) {
+  if (atlas->texture) {
+    SDL_DestroyTexture(atlas->texture);
+    atlas->texture = NULL;
+  }
+}
+
+// Draws a non-negative number right-aligned to rightX using one copy from the atlas per digit
+void drawNumber(int number, float rightX, float y, float digitWidth, float digitHeight, int layer = 1) {
+  SDL_FRect digitRect {rightX, y, digitWidth, digitHeight};
+  do {
+    digitRect.x -= digitWidth;
+    renderQueue.copy(digitAtlas.texture, &digitAtlas.digits[number % 10], digitRect, WHITE, layer);
+    number /= 10;
+  } while (number > 0);
+}
+
+// Clears to a black screen and queues the net beneath everything else
+void drawBackground() {
   SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
   SDL_RenderClear(renderer);
 
-  // Draw the net
-  SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
   int netRectSpace = WINDOW_HEIGHT / 30; // There are 30 rectangles to represent the net
-  SDL_Rect netRect {WINDOW_WIDTH / 2, 0, 3, 12};
+  SDL_FRect netRect {WINDOW_WIDTH / 2, 0, 3, 12};
   for (int y = 0; y < WINDOW_HEIGHT; y += netRectSpace) {
     netRect.y = y;
-    SDL_RenderFillRect(renderer, &netRect);
+    renderQueue.fillRect(netRect, WHITE, 0);
   }
-
-  SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-  
-  // Draw paddles and ball
-  if (renderPaddles) {
-    SDL_RenderFillRectF(renderer, &paddleLeft.rect);
-    SDL_RenderFillRectF(renderer, &paddleRight.rect);
-  }
-  SDL_RenderFillRectF(renderer, &ball.rect);
-
-  // Draw the scores
-  const char* scoreTextLeft = std::to_string(paddleLeft.score).c_str();
-  const char* scoreTextRight = std::to_string(paddleRight.score).c_str();
-  SDL_Surface* scoreSurfaceLeft = 
-    TTF_RenderText_Solid(scoreFont, scoreTextLeft, {255, 255, 255, 255});
-  SDL_Surface* scoreSurfaceRight = 
-    TTF_RenderText_Solid(scoreFont, scoreTextRight, {255, 255, 255, 255});
-  // It's easier to render the text as a texture rather than a surface
-  SDL_Texture* scoreTextureLeft = SDL_CreateTextureFromSurface(renderer, scoreSurfaceLeft);
-  SDL_Texture* scoreTextureRight = SDL_CreateTextureFromSurface(renderer, scoreSurfaceRight);
-  int scoreDistFromTop = 32, scoreWidth = 73, scoreHeight = 100;
-  SDL_Rect scoreRectLeft {
-    paddleLeft.score < 10 ? 273 : 273 - scoreWidth, scoreDistFromTop,
-    paddleLeft.score < 10 ? scoreWidth : 2 * scoreWidth, scoreHeight
-  };
-  SDL_Rect scoreRectRight {
-    paddleRight.score < 10 ? 811 : 811 - scoreWidth, scoreDistFromTop,
-    paddleRight.score < 10 ? scoreWidth : 2 * scoreWidth, scoreHeight
-  };
-  SDL_RenderCopy(renderer, scoreTextureLeft, NULL, &scoreRectLeft);
-  SDL_RenderCopy(renderer, scoreTextureRight, NULL, &scoreRectRight);
-
-  // Free the surface and destroy the texture since they aren't needed anymore
-  SDL_FreeSurface(scoreSurfaceLeft);
-  SDL_FreeSurface(scoreSurfaceRight);
-  SDL_DestroyTexture(scoreTextureLeft);
-  SDL_DestroyTexture(scoreTextureRight);
 }
 
-void updatePaddlePosition(Paddle* paddle, float delta_time) {
-    paddle->rect.y -= 
-      paddle->velocity * delta_time;
-    if (paddle->rect.y > WINDOW_HEIGHT - PADDLE_HEIGHT) {
-      paddle->rect.y = WINDOW_HEIGHT - PADDLE_HEIGHT;
-    } else if (paddle->rect.y < 0) {
-      paddle->rect.y = 0;
+// Redraws the background into its texture if it was lost or never drawn
+void updateBackgroundLayer(BackgroundLayer* layer) {
+  if (!layer->dirty || layer->unsupported) {
+    return;
+  }
+  if (!layer->texture) {
+    layer->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+      SDL_TEXTUREACCESS_TARGET, WINDOW_WIDTH, WINDOW_HEIGHT);
+    if (!layer->texture) {
+      // Target textures aren't supported, so rather than trying again every frame the
+      // background is drawn directly until the renderer is reset
+      layer->unsupported = true;
+      return;
     }
+  }
+  SDL_SetRenderTarget(renderer, layer->texture);
+  drawBackground();
+  renderQueue.flush(renderer);
+  SDL_SetRenderTarget(renderer, NULL);
+  layer->dirty = false;
 }
 
-void updateBallPosition(float delta_time) {
-  ball.rect.x += ball.velX * delta_time;
-  ball.rect.y -= ball.velY * delta_time;
+void destroyBackgroundLayer(BackgroundLayer* layer) {
+  if (layer->texture) {
+    SDL_DestroyTexture(layer->texture);
+    layer->texture = NULL;
+  }
+  layer->dirty = true;
+  layer->unsupported = false; // A new renderer might support it
 }
 
-// Returns if 2 floating point Rects are colliding
-// Needed because SDL_HasIntersection only works with integer Rects
-bool areColliding(SDL_FRect r1, SDL_FRect r2) {
-  return
-    r1.x < r2.x + r2.w &&
-    r1.x + r1.w > r2.x &&
-    r1.y < r2.y + r2.h &&
-    r1.y + r1.h > r2.y;
+// Rebuilds any textures that were invalidated by the renderer or window changing
+void handleRenderEvent(const SDL_Event& event) {
+  if (event.type == SDL_RENDER_DEVICE_RESET) { // Every texture is gone
+    destroyBackgroundLayer(&backgroundLayer);
+    destroyDigitAtlas(&digitAtlas);
+    createDigitAtlas(&digitAtlas, scoreFont);
+  } else if (event.type == SDL_RENDER_TARGETS_RESET) { // Only target texture contents are gone
+    backgroundLayer.dirty = true;
+  } else if (event.type == SDL_WINDOWEVENT && event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+    backgroundLayer.dirty = true;
+  }
 }
 
-// Respawns the ball at a random point with random velocity on the net after 3 seconds
-void respawnBall() {
-  // Set the ball off screen and set the ball respawn timer
-  if (!ballRespawning) {
-    ball.velX = 0;
-    ball.velY = 0;
-    ball.rect.x = -50;
-    ball.rect.y = -50;
-    ballRespawnTime = 3000;
-    ballRespawning = true;
-  } else { // Spawn in the ball
-    ballRespawning = false;
-    int randomNumber = rand();
-    float angle = (randomNumber % 90 - 45) * PI / 180.0f; // -45 deg. to 45 deg. (prevents vertical start)
-    ball.velX = cos(angle) * BALL_SPEED * (leftSideServing ? 1 : -1);
-    ball.velY = sin(angle) * BALL_SPEED;
-    ball.rect.x = WINDOW_WIDTH / 2.0f - BALL_RADIUS;
-    ball.rect.y = randomNumber % int(WINDOW_HEIGHT - BALL_RADIUS * 2) + BALL_RADIUS * 2.0f;
+// Blends between where a rect was before the last step and where it is now
+SDL_FRect interpolateRect(const Rect& previous, const Rect& current, float alpha) {
+  return {
+    float(previous.x) + float(current.x - previous.x) * alpha,
+    float(previous.y) + float(current.y - previous.y) * alpha,
+    float(current.w), float(current.h)
+  };
+}
+
+// Draws the background, net paddles, ball, and scores
+// Alpha is how far between the previous and current simulation step to draw things
+void drawGame(const GameState* previous, const GameState* game, float alpha) {
+  // The render stats shown are from the previous frame since this one hasn't been drawn yet
+  RenderStats lastFrameStats = renderQueue.stats();
+
+  // Draw the black screen and net
+  updateBackgroundLayer(&backgroundLayer);
+  if (!backgroundLayer.dirty) {
+    renderQueue.copy(backgroundLayer.texture, NULL, {0, 0, WINDOW_WIDTH, WINDOW_HEIGHT}, WHITE, 0);
+  } else {
+    drawBackground();
+  }
+
+  // Draw paddles and ball
+  if (!game->gameOver) {
+    renderQueue.fillRect(interpolateRect(previous->paddleLeft.rect, game->paddleLeft.rect, alpha), WHITE);
+    renderQueue.fillRect(interpolateRect(previous->paddleRight.rect, game->paddleRight.rect, alpha), WHITE);
   }
+  renderQueue.fillRect(interpolateRect(previous->ball.rect, game->ball.rect, alpha), WHITE);
+
+  // Draw the scores, each digit is 73x100 and the ones place stays put as the score grows
+  drawNumber(game->paddleLeft.score, 346, 32, 73, 100);
+  drawNumber(game->paddleRight.score, 884, 32, 73, 100);
+
+  // Draw calls and state changes in the top left corner
+  if (showRenderStats) {
+    drawNumber(lastFrameStats.drawCalls, 60, 8, 12, 16, 2);
+    drawNumber(lastFrameStats.stateChanges, 60, 28, 12, 16, 2);
+  }
+
+  renderQueue.flush(renderer);
 }
 
-// Adjust ball velocity if it hits a paddle
-void paddleHitBall(bool leftPaddle) {
-  // How far from center of the paddle is the middle of the ball
-  float relativeBallPaddle = 
-    ((leftPaddle ? paddleLeft.rect.y : paddleRight.rect.y) + PADDLE_HEIGHT / 2)
-    - (ball.rect.y + BALL_RADIUS);
-  // Either edge of paddle is 1, middle of paddle is 0
-  float normalizedBallPaddle = relativeBallPaddle / (PADDLE_HEIGHT / 2);
-  float angle = normalizedBallPaddle * 45 * PI / 180.0f; // 75 deg is the max angle we want
-  // Ball goes faster if hit on edge, slower if in center
-  float speedMultiplier = 0.5 * sin(3 * normalizedBallPaddle - PI / 2) + 1.2;
-  ball.velX = speedMultiplier * BALL_SPEED * cos(angle) * (leftPaddle ? 1 : -1);
-  ball.velY = speedMultiplier * BALL_SPEED * sin(angle);
+// Plays the sounds raised by the simulation since the last frame
+void playSounds(GameState* game) {
+  if (game->soundEvents & SOUND_PADDLE) Mix_PlayChannel(-1, soundHitPaddle, 0);
+  if (game->soundEvents & SOUND_WALL) Mix_PlayChannel(-1, soundHitWall, 0);
+  if (game->soundEvents & SOUND_SCORE) Mix_PlayChannel(-1, soundScore, 0);
+  game->soundEvents = 0;
 }
 
-// Act based on if the ball collided with something
-void ballCollision(bool playing) {
-  if (playing && areColliding(ball.rect, paddleLeft.rect)) {
-    Mix_PlayChannel(-1, soundHitPaddle, 0);
-    paddleHitBall(true);
-  }
-  else if (playing && areColliding(ball.rect, paddleRight.rect)) {
-    Mix_PlayChannel(-1, soundHitPaddle, 0);
-    paddleHitBall(false);
-  }
-  else if (ball.rect.y + BALL_RADIUS * 2 > WINDOW_HEIGHT || ball.rect.y < 0) { // Top or bottom of screen
-    if (playing) Mix_PlayChannel(-1, soundHitWall, 0);
-    ball.velY *= -1;
-    ball.rect.y += ball.velY > 0 ? -1 : 1;
-  }
-  else if (ball.rect.x < 0) { // Left side of screen
-    if (playing) {
-      ++paddleRight.score;
-      Mix_PlayChannel(-1, soundScore, 0);
-      leftSideServing = false;
-      respawnBall();
+void printUsage() {
+  std::cout << "Usage: pong [--vsync | --fps <frames per second> | --uncapped] [--seed <seed>]\n"
+    << "            [--record <file> [--checksums <steps>] | --replay <file>]\n"
+    << "       pong --headless [--matches <count>] [--seed <seed>] [--event-driven]\n"
+    << "       pong --headless --replay <file>\n"
+    << "       pong --headless --shared-memory <name> [--matches <count>] [--seed <seed>]\n"
+    << "       pong (--host <port> | --join <host>:<port>) [--seed <seed>] [network test options]\n"
+    << "       pong --headless --net-test [--seed <seed>] [--loss <fraction>] [--delay <ms>] [--jitter <ms>]\n"
+    << "       pong --server <host>:<port> [--spectate <match id>]\n"
+    << "  --vsync     Wait for the display between frames (default)\n"
+    << "  --fps       Limit the frame rate without vsync\n"
+    << "  --uncapped  Draw frames as fast as possible\n"
+    << "  --headless  Play AI against AI as fast as possible without a window or audio\n"
+    << "  --matches   How many matches to play headless\n"
+    << "  --event-driven Jump headless matches from one ball event to the next instead of stepping\n"
+    << "  --seed      Seed for every serve, the same seed and inputs play out the same match\n"
+    << "  --record    Save the seed and every input to a replay file\n"
+    << "  --checksums Also save a hash of the game every so many steps to check replays against\n"
+    << "  --replay    Play a replay file back, headless only prints how it ended\n"
+    << "  --shared-memory Play the left paddle of every match for a trainer through POSIX shared memory\n"
+    << "  --host      Wait for somebody to join an online match on the UDP port, the host plays left\n"
+    << "  --join      Join an online match, W/S or Up/Down move your paddle\n"
+    << "  --net-test  Play two online AIs against each other over loopback and check they agree\n"
+    << "  --server    Play a match on pong-server against whoever it pairs you with\n"
+    << "  --spectate  Watch a match on pong-server instead of playing\n"
+    << "  --loss      Drop this fraction of sent packets, for testing online play\n"
+    << "  --delay     Hold every sent packet back this many milliseconds\n"
+    << "  --jitter    Vary each packet's delay by up to this many milliseconds either way\n";
+}
+
+// Reads <host>:<port>
+bool findHost(const char* text, NetAddress* address) {
+  std::string host = text;
+  size_t colon = host.rfind(':');
+  int port = colon == std::string::npos ? 0 : atoi(host.c_str() + colon + 1);
+  return port > 0 && port <= 65535 && resolveAddress(host.substr(0, colon).c_str(), port, address);
+}
+
+// Plays AI against AI without ever creating a window, renderer, or audio device
+int runHeadless(int matches, uint64_t seed, bool eventDriven) {
+  GameState game;
+  initGame(&game, seed);
+  int leftWins = 0, rightWins = 0, abandoned = 0;
+  long long totalSteps = 0;
+  auto startTime = std::chrono::steady_clock::now();
+  for (int match = 0; match < matches; ++match) {
+    restartGame(&game);
+    game.player1Ai = true;
+    game.player2Ai = true;
+    long long steps = 0;
+    bool won = false;
+    if (eventDriven) {
+      // A second at a time at most so it stays in range of a fixed point Real
+      double time = 0, maxTime = MAX_MATCH_STEPS * double(SIMULATION_STEP);
+      while (!game.gameOver && time < maxTime) {
+        time += float(advanceToNextEvent(&game, Real(float(std::min(maxTime - time, 1000.0)))));
+      }
+      won = game.gameOver;
+      steps = std::min(MAX_MATCH_STEPS, (long long)(time / SIMULATION_STEP + 0.5));
+    }
+    while (!won && steps < MAX_MATCH_STEPS) {
+      won = stepGameplay(&game, SIMULATION_STEP);
+      ++steps;
+    }
+    totalSteps += steps;
+    if (!won) {
+      ++abandoned;
+    } else if (game.paddleLeft.score > game.paddleRight.score) {
+      ++leftWins;
     } else {
-      ball.velX *= -1;
-      ball.rect.x -= ball.velX > 0 ? -1 : 1;
+      ++rightWins;
     }
   }
-  else if (ball.rect.x + BALL_RADIUS * 2 > WINDOW_WIDTH) { // Right side of screen
-    if (playing) {
-      ++paddleLeft.score;
-      Mix_PlayChannel(-1, soundScore, 0);
-      leftSideServing = true;
-      respawnBall();
-    } else {
-      ball.velX *= -1;
-      ball.rect.x -= ball.velX > 0 ? -1 : 1;
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+  std::cout << "Seed: " << seed << "\n";
+  std::cout << "Matches: " << matches << ", left wins: " << leftWins << ", right wins: " << rightWins;
+  if (abandoned > 0) std::cout << ", abandoned: " << abandoned;
+  std::cout << "\nSimulated " << totalSteps * SIMULATION_STEP / 1000.0 << " s of play in "
+    << seconds << " s (" << totalSteps / std::max(seconds, 1e-9) << " steps/s)\n";
+  return 0;
+}
+
+// Names the kind of build that SimulationFlags describe
+std::string describeSimulation(uint8_t flags) {
+  return std::string(flags & SIMULATION_FIXED_POINT ? "Fixed Point" : "Float") +
+    (flags & SIMULATION_LIBM_TRIG ? " Libm Trig" : " Table Trig");
+}
+
+// Checks the game against the hash the replay saved for this step, if it saved one.
+// Returns false if they differ, meaning the simulation no longer matches the recording.
+bool checkReplayStep(const ReplayReader* replay, const GameState* game, int* checksumsMatched) {
+  uint32_t expected;
+  if (!replay->checksumFor(game->tick, &expected)) {
+    return true;
+  }
+  uint32_t actual = hashGameState(game);
+  if (actual != expected) {
+    std::cout << "Replay desynced at step " << game->tick << ": expected checksum " << std::hex
+      << expected << " but got " << actual << std::dec << "\n";
+    return false;
+  }
+  ++*checksumsMatched;
+  return true;
+}
+
+// Re-simulates a replay as fast as possible and prints how the match ended
+int runReplayHeadless(ReplayReader* replay) {
+  GameState game;
+  initGame(&game, replay->seed());
+  int checksumsMatched = 0;
+  std::cout << "Seed: " << replay->seed() << "\n";
+  while (!replay->finished(game.tick)) {
+    uint8_t input = replay->inputFor(game.tick);
+    if (!checkReplayStep(replay, &game, &checksumsMatched)) {
+      return 1;
     }
+    stepGame(&game, input, SIMULATION_STEP);
+  }
+  std::cout << "Replay ended after " << game.tick << " steps with a score of "
+    << game.paddleLeft.score << " - " << game.paddleRight.score << "\n";
+  if (checksumsMatched > 0) {
+    std::cout << "All " << checksumsMatched << " checksums matched\n";
+  }
+  return 0;
+}
+
+// Copies what the trainer sees of every match into the observation buffer
+void writeSharedObservations(const VectorEnv& env, float* observations) {
+  const AiObservations& observed = env.observations();
+  int matches = env.size();
+  for (int i = 0; i < matches; ++i) {
+    const GameState& game = env.game(i);
+    observations[SHARED_PADDLE_Y * matches + i] = float(observed.paddleY[i]);
+    observations[SHARED_OPPONENT_Y * matches + i] = float(observed.opponentY[i]);
+    observations[SHARED_BALL_X * matches + i] = float(observed.ballX[i]);
+    observations[SHARED_BALL_Y * matches + i] = float(observed.ballY[i]);
+    observations[SHARED_BALL_VEL_X * matches + i] = float(observed.ballVelX[i]);
+    observations[SHARED_BALL_VEL_Y * matches + i] = float(observed.ballVelY[i]);
+    observations[SHARED_BALL_IN_PLAY * matches + i] = observed.ballInPlay[i];
+    observations[SHARED_SCORE * matches + i] = game.paddleLeft.score;
+    observations[SHARED_OPPONENT_SCORE * matches + i] = game.paddleRight.score;
+    observations[SHARED_REWARD * matches + i] = env.rewards()[i];
+    observations[SHARED_DONE * matches + i] = env.dones()[i];
   }
 }
 
-// Resets scores, serve, ball, and AI
-void restartGame() {
-  paddleLeft.score = 0;
-  paddleLeft.rect.y = PADDLE_SPAWN_Y;
-  paddleRight.score = 0;
-  paddleRight.rect.y = PADDLE_SPAWN_Y;
-  leftSideServing = rand() % 2; // Random initial serve
-  ballRespawning = false;
-  player2Ai = true;
-  respawnBall();
+// Plays matches for a trainer in another process through shared memory until it says to stop
+int runSharedMemory(const char* name, int matches, uint64_t seed) {
+  SharedBuffers buffers(name, matches);
+  if (!buffers.isOpen()) {
+    std::cout << buffers.error() << " " << name << " Failed\n";
+    return 1;
+  }
+  VectorEnv env(matches);
+  std::vector<uint64_t> seeds(matches);
+  for (int i = 0; i < matches; ++i) {
+    seeds[i] = seed + i;
+  }
+  env.reset(seeds.data());
+  std::cout << "Seed: " << seed << "\nServing " << matches << " matches on shared memory " << name << "\n";
+
+  auto startTime = std::chrono::steady_clock::now();
+  uint64_t frame = 0;
+  while (true) {
+    writeSharedObservations(env, buffers.observationBuffer());
+    buffers.publishObservations(frame);
+    const uint8_t* actions = buffers.waitForActions(frame);
+    if (!actions) {
+      break;
+    }
+    env.step(actions);
+    ++frame;
+  }
+  if (buffers.trainerLost()) {
+    std::cout << "Hearing From Trainer On " << name << " Failed after " << frame << " steps\n";
+    return 1;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  std::cout << "Trainer stopped after " << frame << " steps (" << frame * matches / std::max(seconds, 1e-9)
+    << " match steps/s)\n";
+  return 0;
+}
+
+// Up or down to chase the ball like the built in AI, as paddle input for a rollback session.
+// It looks away for a while every so often so points still get scored at full paddle speed.
+uint8_t chaseInput(const GameState& game, bool leftSide) {
+  const Paddle& paddle = leftSide ? game.paddleLeft : game.paddleRight;
+  Real distance = (paddle.rect.y + PADDLE_HEIGHT / 2) - (game.ball.rect.y + BALL_RADIUS);
+  bool distracted = (game.tick + (leftSide ? 0 : 300)) % 720 < 240;
+  if (distracted || game.ball.rect.y < 0 || fabs(distance) <= AiSettings().deadZone) {
+    return 0;
+  }
+  return distance > 0 ? INPUT_LEFT_UP : INPUT_LEFT_DOWN;
+}
+
+void printRollbackStats(const char* side, const RollbackSession& session) {
+  const RollbackStats& stats = session.stats();
+  std::cout << side << ": " << stats.rollbacks << " rollbacks, " << stats.resimulatedSteps << " steps played again, "
+    << "deepest " << stats.deepestRollback << ", " << stats.stalls << " stalls, "
+    << stats.checksumsMatched << " checksums matched, " << stats.syncWaits << " steps held back, "
+    << "ahead by " << stats.frameAdvantage << (stats.desynced ? ", DESYNCED" : "") << "\n";
+}
+
+// Plays two rollback sessions against each other through real sockets on loopback, with the
+// links dropping and delaying packets, then checks both ended up with exactly the same game
+int runNetTest(const LinkConditions& conditions, uint64_t seed) {
+  UdpSocket hostSocket, joinSocket;
+  NetAddress hostAddress;
+  if (!hostSocket.open(0) || !joinSocket.open(0) ||
+      !resolveAddress("127.0.0.1", hostSocket.localPort(), &hostAddress)) {
+    std::cout << "Opening Loopback UDP Sockets Failed\n";
+    return 1;
+  }
+  RollbackSession host(&hostSocket, seed, conditions);
+  RollbackSession joined(&joinSocket, hostAddress, conditions);
+  std::cout << "Seed: " << seed << ", loss: " << conditions.loss << ", delay: " << conditions.delay
+    << " ms, jitter: " << conditions.jitter << " ms\n";
+
+  // Time is simulated so the test runs as fast as it can, each loop is one step's worth
+  auto startTime = std::chrono::steady_clock::now();
+  long long loops = 0;
+  // Rows at half a second then every doubling of that show the two sides evening out
+  long long nextRow = 120;
+  long long hostRollbacks = 0, joinedRollbacks = 0; // As of the last row
+  bool done = false;
+  while (!done) {
+    double now = loops++ * double(SIMULATION_STEP);
+    host.poll(now);
+    joined.poll(now);
+    if (host.tick() < NET_TEST_STEPS) host.advance(chaseInput(host.state(), true), now);
+    if (joined.tick() < NET_TEST_STEPS) joined.advance(chaseInput(joined.state(), false), now);
+    // The host starts ahead by the delay, these show it evening out and the rollbacks with it
+    if (loops == nextRow || loops == NET_TEST_STEPS) {
+      std::cout << "After " << loops / 240.0 << " s: host ahead by " << host.stats().frameAdvantage << " steps, "
+        << host.stats().rollbacks - hostRollbacks << " host and " << joined.stats().rollbacks - joinedRollbacks
+        << " joined rollbacks since the last row\n";
+      hostRollbacks = host.stats().rollbacks;
+      joinedRollbacks = joined.stats().rollbacks;
+      nextRow *= 2;
+    }
+    // Carry on until both have every input, so neither can be corrected any more
+    done = host.confirmedTick() >= NET_TEST_STEPS && joined.confirmedTick() >= NET_TEST_STEPS;
+    if (loops > NET_TEST_STEPS * 10) {
+      std::cout << "Online Test Stopped Making Progress, Failed\n";
+      return 1;
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+  printRollbackStats("Host", host);
+  printRollbackStats("Joined", joined);
+  uint32_t hostHash = hashGameState(&host.state()), joinedHash = hashGameState(&joined.state());
+  std::cout << "Played " << NET_TEST_STEPS << " steps in " << seconds << " s, score "
+    << host.state().paddleLeft.score << " - " << host.state().paddleRight.score << ", final checksums "
+    << std::hex << hostHash << " and " << joinedHash << std::dec << "\n";
+  if (hostHash != joinedHash || host.stats().desynced || joined.stats().desynced) {
+    std::cout << "Online Test Desynced, Failed\n";
+    return 1;
+  }
+  return 0;
 }
 
 int main(int argc, char *argv[]) {
+  // Command line options
+  PacingMode pacingMode = PACING_VSYNC;
+  int targetFps = DEFAULT_TARGET_FPS;
+  bool headless = false;
+  bool eventDriven = false;
+  int headlessMatches = DEFAULT_HEADLESS_MATCHES;
+  uint64_t seed = time(0);
+  const char* recordPath = NULL;
+  const char* replayPath = NULL;
+  const char* sharedMemoryName = NULL;
+  int hostPort = 0;
+  const char* joinAddress = NULL;
+  const char* serverAddress = NULL;
+  long long spectateMatch = -1;
+  bool netTest = false;
+  LinkConditions linkConditions;
+  int checksumInterval = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--vsync") {
+      pacingMode = PACING_VSYNC;
+    } else if (arg == "--fps" && i + 1 < argc) {
+      pacingMode = PACING_TARGET_FPS;
+      targetFps = atoi(argv[++i]);
+      if (targetFps <= 0) {
+        printUsage();
+        return 1;
+      }
+    } else if (arg == "--uncapped") {
+      pacingMode = PACING_UNCAPPED;
+    } else if (arg == "--headless") {
+      headless = true;
+    } else if (arg == "--event-driven") {
+      eventDriven = true;
+    } else if (arg == "--matches" && i + 1 < argc) {
+      headlessMatches = atoi(argv[++i]);
+      if (headlessMatches <= 0) {
+        printUsage();
+        return 1;
+      }
+    } else if (arg == "--seed" && i + 1 < argc) {
+      seed = strtoull(argv[++i], NULL, 10);
+    } else if (arg == "--record" && i + 1 < argc) {
+      recordPath = argv[++i];
+    } else if (arg == "--checksums" && i + 1 < argc) {
+      checksumInterval = atoi(argv[++i]);
+      if (checksumInterval <= 0) {
+        printUsage();
+        return 1;
+      }
+    } else if (arg == "--replay" && i + 1 < argc) {
+      replayPath = argv[++i];
+    } else if (arg == "--shared-memory" && i + 1 < argc) {
+      sharedMemoryName = argv[++i];
+    } else if (arg == "--host" && i + 1 < argc) {
+      hostPort = atoi(argv[++i]);
+      if (hostPort <= 0 || hostPort > 65535) {
+        printUsage();
+        return 1;
+      }
+    } else if (arg == "--join" && i + 1 < argc) {
+      joinAddress = argv[++i];
+    } else if (arg == "--server" && i + 1 < argc) {
+      serverAddress = argv[++i];
+    } else if (arg == "--spectate" && i + 1 < argc) {
+      spectateMatch = atoll(argv[++i]);
+      if (spectateMatch < 0 || spectateMatch > UINT32_MAX) {
+        printUsage();
+        return 1;
+      }
+    } else if (arg == "--net-test") {
+      netTest = true;
+    } else if (arg == "--loss" && i + 1 < argc) {
+      linkConditions.loss = atof(argv[++i]);
+    } else if (arg == "--delay" && i + 1 < argc) {
+      linkConditions.delay = atof(argv[++i]);
+    } else if (arg == "--jitter" && i + 1 < argc) {
+      linkConditions.jitter = atof(argv[++i]);
+    } else {
+      printUsage();
+      return 1;
+    }
+  }
+
+  if ((recordPath && replayPath) || (checksumInterval > 0 && !recordPath) || (eventDriven && (!headless || replayPath)) ||
+      (sharedMemoryName && (!headless || replayPath || recordPath || eventDriven)) ||
+      (netTest && !headless) || ((hostPort || joinAddress) && (headless || replayPath || recordPath)) ||
+      (serverAddress && (headless || replayPath || recordPath)) || (hostPort && joinAddress) ||
+      (serverAddress && (hostPort || joinAddress)) || (spectateMatch >= 0 && !serverAddress)) {
+    printUsage();
+    return 1;
+  }
+  std::unique_ptr<ReplayReader> replay;
+  if (replayPath) {
+    replay.reset(new ReplayReader(replayPath));
+    if (!replay->isOpen()) {
+      std::cout << "Reading Replay File " << replayPath << " Failed\n";
+      return 1;
+    }
+    if (replay->flags() != SIMULATION_FLAGS) {
+      std::cout << "Replay Was Recorded By A " << describeSimulation(replay->flags()) << " Build, This Is A "
+        << describeSimulation(SIMULATION_FLAGS) << " Build, Playing It Failed\n";
+      return 1;
+    }
+    seed = replay->seed();
+  }
+  if (sharedMemoryName) {
+    return runSharedMemory(sharedMemoryName, headlessMatches, seed);
+  }
+  if (netTest) {
+    return runNetTest(linkConditions, seed);
+  }
+  UdpSocket netSocket;
+  std::unique_ptr<RollbackSession> session;
+  std::unique_ptr<ServerClient> client;
+  if (hostPort) {
+    if (!netSocket.open(hostPort)) {
+      std::cout << "Opening UDP Port " << hostPort << " Failed\n";
+      return 1;
+    }
+    session.reset(new RollbackSession(&netSocket, seed, linkConditions));
+    std::cout << "Waiting for somebody to join on port " << hostPort << "\n";
+  } else if (joinAddress || serverAddress) {
+    NetAddress host;
+    if (!findHost(joinAddress ? joinAddress : serverAddress, &host)) {
+      std::cout << "Finding Host " << (joinAddress ? joinAddress : serverAddress) << " Failed\n";
+      return 1;
+    }
+    if (!netSocket.open(0)) {
+      std::cout << "Opening UDP Socket Failed\n";
+      return 1;
+    }
+    if (joinAddress) {
+      session.reset(new RollbackSession(&netSocket, host, linkConditions));
+    } else {
+      client.reset(spectateMatch >= 0 ? new ServerClient(&netSocket, host, uint32_t(spectateMatch))
+        : new ServerClient(&netSocket, host));
+    }
+  }
+  if (headless) {
+    return replay ? runReplayHeadless(replay.get()) : runHeadless(headlessMatches, seed, eventDriven);
+  }
+  std::unique_ptr<ReplayWriter> recorder;
+  if (recordPath) {
+    recorder.reset(new ReplayWriter(recordPath, seed, SIMULATION_FLAGS));
+    if (!recorder->isOpen()) {
+      std::cout << "Creating Replay File " << recordPath << " Failed\n";
+      return 1;
+    }
+  }
+
   // Initializations
   if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0) {
     std::cout << "SDL Video or Audio Initialization Failed\n" << SDL_GetError();
@@ -228,7 +625,6 @@ int main(int argc, char *argv[]) {
     std::cout << "SDL Mixer Audio Initialization Failed\n" << Mix_GetError();
     return 1;
   }
-  srand(time(0));
 
   // SDL variable assignments
   window = SDL_CreateWindow("Pong", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
@@ -237,16 +633,31 @@ int main(int argc, char *argv[]) {
     std::cout << "SDL Window Creation Failed\n" << SDL_GetError();
     return 1;
   }
-  renderer = SDL_CreateRenderer(window, -1, 0);
+  renderer = SDL_CreateRenderer(window, -1, pacingMode == PACING_VSYNC ? SDL_RENDERER_PRESENTVSYNC : 0);
   if (!renderer) {
     std::cout << "SDL Renderer Creation Failed\n" << SDL_GetError();
     return 1;
   }
+  // Not every renderer can wait for vsync so fall back to limiting to the display's refresh rate
+  SDL_RendererInfo rendererInfo;
+  if (pacingMode == PACING_VSYNC && SDL_GetRendererInfo(renderer, &rendererInfo) == 0 &&
+    !(rendererInfo.flags & SDL_RENDERER_PRESENTVSYNC)) {
+    SDL_DisplayMode displayMode;
+    pacingMode = PACING_TARGET_FPS;
+    if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &displayMode) == 0 &&
+      displayMode.refresh_rate > 0) {
+      targetFps = displayMode.refresh_rate;
+    }
+  }
   scoreFont = TTF_OpenFont(SCORE_FONT_LOCATION, 24);
   if (!scoreFont) {
     std::cout << "Opening Font File " << SCORE_FONT_LOCATION << " Failed\n" << TTF_GetError();
     return 1;
   }
+  if (!createDigitAtlas(&digitAtlas, scoreFont)) {
+    std::cout << "Creating Digit Atlas Failed\n" << SDL_GetError();
+    return 1;
+  }
   soundHitPaddle = Mix_LoadWAV(SFX_PADDLE_LOCATION);
   soundHitWall = Mix_LoadWAV(SFX_WALL_LOCATION);
   soundScore = Mix_LoadWAV(SFX_SCORE_LOCATION);
@@ -256,123 +667,168 @@ int main(int argc, char *argv[]) {
   }
 
   // Initialize the game objects
-  paddleLeft.rect.x = PADDLE_SPACING_FROM_EDGE;
-  paddleRight.rect.x = WINDOW_WIDTH - PADDLE_SPACING_FROM_EDGE - PADDLE_WIDTH;
-  leftSideServing = rand() % 2; // Random initial serve
-  respawnBall();
+  GameState game;
+  initGame(&game, seed);
+  GameState previousGame = game; // The state before the latest step, for interpolating
 
   bool gameRunning = true;
-  bool gameOver = false;
+  uint8_t heldInput = 0; // Paddle directions from the keys currently held
+  uint8_t pendingActions = 0; // One off actions waiting for the next step
+  bool replayDesynced = false;
+  bool matchAnnounced = false;
+  int checksumsMatched = 0;
   float delta_time = 0.0f;
+  float accumulator = 0.0f; // Time that still needs to be simulated
+  FramePacer framePacer(pacingMode, targetFps);
   while (gameRunning) {
-    auto startTime = std::chrono::high_resolution_clock::now();
-
-    if (!gameOver) { // Gameplay
-      // Handle Input
-      while (SDL_PollEvent(&event)) {
-        if (event.type == SDL_QUIT) {
-          gameRunning = false;
-        } else if (event.type == SDL_KEYDOWN) {
-          switch (event.key.keysym.sym) {
-            case SDLK_ESCAPE:
-              gameRunning = false;
-              break;
-            case SDLK_r:
-              restartGame();
-              break;
-            case SDLK_w:
-              paddleLeft.velocity = PADDLE_SPEED;
-              break;
-            case SDLK_s:
-              paddleLeft.velocity = -PADDLE_SPEED;
-              break;
-            case SDLK_UP:
-              if (!player2Ai) paddleRight.velocity = PADDLE_SPEED;
-              break;
-            case SDLK_DOWN:
-              if (!player2Ai) paddleRight.velocity = -PADDLE_SPEED;
-              break;
-          }
-        } else if (event.type == SDL_KEYUP) {
-          switch (event.key.keysym.sym) {
-            case SDLK_w:
-            case SDLK_s:
-              paddleLeft.velocity = 0.0f;
-              break;
-            case SDLK_UP:
-            case SDLK_DOWN:
-              if (!player2Ai) paddleRight.velocity = 0.0f;
-              break;
-            case SDLK_a:
-              player2Ai = !player2Ai;
-              paddleRight.velocity = 0.0f;
-              break;
-          }
+    // Handle Input
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+      handleRenderEvent(event);
+      if (event.type == SDL_QUIT) {
+        gameRunning = false;
+      } else if (event.type == SDL_KEYDOWN) {
+        switch (event.key.keysym.sym) {
+          case SDLK_ESCAPE:
+            gameRunning = false;
+            break;
+          case SDLK_r:
+            pendingActions |= INPUT_RESTART;
+            break;
+          case SDLK_w:
+            heldInput = (heldInput & ~INPUT_LEFT_MASK) | INPUT_LEFT_UP;
+            break;
+          case SDLK_s:
+            heldInput = (heldInput & ~INPUT_LEFT_MASK) | INPUT_LEFT_DOWN;
+            break;
+          case SDLK_UP:
+            heldInput = (heldInput & ~INPUT_RIGHT_MASK) | INPUT_RIGHT_UP;
+            break;
+          case SDLK_DOWN:
+            heldInput = (heldInput & ~INPUT_RIGHT_MASK) | INPUT_RIGHT_DOWN;
+            break;
         }
-      }
-
-      if (ballRespawning) {
-        ballRespawnTime -= delta_time;
-        if (ballRespawnTime < 0) {
-          respawnBall();
+      } else if (event.type == SDL_KEYUP) {
+        switch (event.key.keysym.sym) {
+          case SDLK_w:
+          case SDLK_s:
+            heldInput &= ~INPUT_LEFT_MASK;
+            break;
+          case SDLK_UP:
+          case SDLK_DOWN:
+            heldInput &= ~INPUT_RIGHT_MASK;
+            break;
+          case SDLK_a:
+            pendingActions |= INPUT_TOGGLE_AI;
+            heldInput &= ~INPUT_RIGHT_MASK;
+            break;
+          case SDLK_F3:
+            showRenderStats = !showRenderStats;
+            break;
         }
-      } else {
-        ballCollision(true);
       }
+    }
 
-      updatePaddlePosition(&paddleLeft, delta_time);
-      if (player2Ai) {
-        float rightPaddleBallVertDist = (paddleRight.rect.y + PADDLE_HEIGHT / 2) - (ball.rect.y + BALL_RADIUS);
-        if (ball.rect.y < 0) rightPaddleBallVertDist = 0.0f;
-        float speedMultAi = 0.7f;
-        if (abs(rightPaddleBallVertDist) > 3) {
-          paddleRight.velocity = speedMultAi * (rightPaddleBallVertDist > 1 ? PADDLE_SPEED : -PADDLE_SPEED);
-        } else {
-          paddleRight.velocity = 0.0f;
-        }
+    // Run as many fixed steps as the time since the last frame covers
+    accumulator += delta_time;
+    int steps = 0;
+    if (session) {
+      session->poll(SDL_GetTicks());
+      if (session->stats().desynced) {
+        std::cout << "Online match desynced at step " << session->confirmedTick() << ", stopping\n";
+        gameRunning = false;
+      } else if (session->refused()) {
+        std::cout << "Joining Failed, the host runs protocol " << int(session->hostProtocolVersion()) << " with a "
+          << describeSimulation(session->hostSimulationFlags()) << " simulation and this is protocol "
+          << int(NET_PROTOCOL_VERSION) << " with " << describeSimulation(SIMULATION_FLAGS) << "\n";
+        gameRunning = false;
+      } else if (session->connected()) {
+        game = session->state(); // A rollback may have changed it even if no step is taken this frame
+      }
+    }
+    if (client) {
+      client->poll(SDL_GetTicks());
+      if (client->lost(SDL_GetTicks())) {
+        std::cout << "Lost Connection To The Server\n";
+        gameRunning = false;
+      } else if (client->refused()) {
+        std::cout << "Finding Match " << client->match() << " Failed\n";
+        gameRunning = false;
+      } else if (client->joined() && !matchAnnounced) {
+        // Players pass this on for others to watch with --spectate
+        std::cout << (client->spectator() ? "Watching" : "Playing") << " match " << client->match() << "\n";
+        matchAnnounced = true;
+      }
+    }
+    while (accumulator >= SIMULATION_STEP && steps < MAX_STEPS_PER_FRAME) {
+      if (replay && replay->finished(game.tick)) { // Hold the last frame once the replay is over
+        previousGame = game;
+        accumulator = 0.0f;
+        break;
       }
-      updatePaddlePosition(&paddleRight, delta_time);
-      updateBallPosition(delta_time);
-
-      drawGame(true);
-      SDL_RenderPresent(renderer);
-      
-      if (paddleLeft.score >= 11 || paddleRight.score >= 11) {
-        ballRespawning = true;
-        respawnBall();
-        gameOver = true;
+      // Online the session steps the game with this side's paddle from either set of keys. When
+      // it's ahead of the other side it holds steps back, dropping their time so it falls back in line.
+      if (session && !session->advance(uint8_t(heldInput | heldInput >> 2) & INPUT_LEFT_MASK, SDL_GetTicks())) {
+        accumulator -= SIMULATION_STEP;
+        ++steps;
+        continue;
       }
-    } else { // Game over screen
-      // Handle Input
-      while (SDL_PollEvent(&event)) {
-        if (event.type == SDL_QUIT) {
-          gameRunning = false;
-        } else if (event.type == SDL_KEYDOWN) {
-          switch (event.key.keysym.sym) {
-            case SDLK_ESCAPE:
-              gameRunning = false;
-              break;
-            case SDLK_r:
-              restartGame();
-              gameOver = false;
-              break;
+      previousGame = game;
+      if (session) {
+        game = session->state();
+      } else if (client) {
+        // The server plays the match, the latest snapshot is shown with this side's paddle
+        // already moved by the inputs the server hasn't played yet
+        client->sendInput(uint8_t(heldInput | heldInput >> 2) & INPUT_LEFT_MASK);
+        game = client->state();
+      } else {
+        // One off actions only go to the first step so they aren't repeated
+        uint8_t input = replay ? replay->inputFor(game.tick) : heldInput | pendingActions;
+        pendingActions = 0;
+        if (replay && !replayDesynced) {
+          replayDesynced = !checkReplayStep(replay.get(), &game, &checksumsMatched);
+        }
+        if (recorder) {
+          if (checksumInterval > 0 && game.tick % checksumInterval == 0) {
+            recorder->recordChecksum(game.tick, hashGameState(&game));
           }
+          recorder->recordInput(game.tick, input);
         }
+        stepGame(&game, input, SIMULATION_STEP);
+      }
+      if (game.ballTeleported) {
+        previousGame.ball = game.ball;
+        game.ballTeleported = false;
       }
-      
-      ballCollision(false);
+      accumulator -= SIMULATION_STEP;
+      ++steps;
+    }
+    if (accumulator >= SIMULATION_STEP) { // Too far behind, so the simulation slows down instead
+      accumulator = fmod(accumulator, SIMULATION_STEP);
+    }
+    if (session) {
+      game.soundEvents = session->takeSoundEvents(); // Steps played again after a rollback stay quiet
+    } else if (client) {
+      game.soundEvents = client->takeSoundEvents();
+    }
+    playSounds(&game);
 
-      updateBallPosition(delta_time);
+    drawGame(&previousGame, &game, accumulator / SIMULATION_STEP);
+    SDL_RenderPresent(renderer);
 
-      drawGame(false);
-      SDL_RenderPresent(renderer);
-    }
-    
-    auto stopTime = std::chrono::high_resolution_clock::now();
-    delta_time = 
-      std::chrono::duration<float, std::chrono::milliseconds::period>(stopTime - startTime).count();
+    delta_time = framePacer.waitForNextFrame();
+  }
+
+  framePacer.printStats(std::cout);
+  if (session) printRollbackStats(session->leftSide() ? "Host" : "Joined", *session);
+  if (client && !client->spectator()) {
+    std::cout << "Paddle corrected " << client->stats().corrections << " times, largest "
+      << client->stats().largestCorrection << " pixels\n";
   }
+  if (recorder) recorder->finish(game.tick);
 
+  destroyBackgroundLayer(&backgroundLayer);
+  destroyDigitAtlas(&digitAtlas);
   TTF_CloseFont(scoreFont);
   SDL_DestroyWindow(window);
   SDL_DestroyRenderer(renderer);
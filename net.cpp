@@ -0,0 +1,167 @@
+#include "net.h"
+#include <string.h>
+#include <algorithm>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef int socklen_t;
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+const intptr_t NO_SOCKET = intptr_t(INVALID_SOCKET);
+
+// Winsock has to be started before anything else is called, once is enough
+static bool startSockets() {
+  static bool started = false;
+  if (!started) {
+    WSADATA data;
+    started = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+  }
+  return started;
+}
+#else
+const intptr_t NO_SOCKET = -1;
+
+static bool startSockets() {
+  return true;
+}
+#endif
+
+static sockaddr_in toSockaddr(const NetAddress& address) {
+  sockaddr_in result;
+  memset(&result, 0, sizeof(result));
+  result.sin_family = AF_INET;
+  result.sin_addr.s_addr = htonl(address.ip);
+  result.sin_port = htons(address.port);
+  return result;
+}
+
+bool resolveAddress(const char* host, uint16_t port, NetAddress* address) {
+  if (!startSockets()) {
+    return false;
+  }
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo* found = NULL;
+  if (getaddrinfo(host, NULL, &hints, &found) != 0 || !found) {
+    return false;
+  }
+  address->ip = ntohl(((sockaddr_in*)found->ai_addr)->sin_addr.s_addr);
+  address->port = port;
+  freeaddrinfo(found);
+  return true;
+}
+
+UdpSocket::UdpSocket() : handle(NO_SOCKET) {}
+
+UdpSocket::~UdpSocket() {
+  closeHandle();
+}
+
+void UdpSocket::closeHandle() {
+  if (handle == NO_SOCKET) {
+    return;
+  }
+#ifdef _WIN32
+  closesocket(SOCKET(handle));
+#else
+  close(int(handle));
+#endif
+  handle = NO_SOCKET;
+}
+
+bool UdpSocket::open(uint16_t port) {
+  if (!startSockets()) {
+    return false;
+  }
+  handle = intptr_t(socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+  if (handle == NO_SOCKET) {
+    return false;
+  }
+  NetAddress any;
+  any.port = port;
+  sockaddr_in address = toSockaddr(any);
+  bool bound = bind(handle, (sockaddr*)&address, sizeof(address)) == 0;
+#ifdef _WIN32
+  u_long nonBlocking = 1;
+  bool configured = ioctlsocket(SOCKET(handle), FIONBIO, &nonBlocking) == 0;
+#else
+  bool configured = fcntl(int(handle), F_SETFL, fcntl(int(handle), F_GETFL) | O_NONBLOCK) == 0;
+#endif
+  if (!bound || !configured) {
+    closeHandle();
+    return false;
+  }
+  return true;
+}
+
+bool UdpSocket::isOpen() const {
+  return handle != NO_SOCKET;
+}
+
+uint16_t UdpSocket::localPort() const {
+  sockaddr_in address;
+  socklen_t size = sizeof(address);
+  if (getsockname(handle, (sockaddr*)&address, &size) != 0) {
+    return 0;
+  }
+  return ntohs(address.sin_port);
+}
+
+bool UdpSocket::send(const NetAddress& to, const uint8_t* data, int size) {
+  sockaddr_in address = toSockaddr(to);
+  return sendto(handle, (const char*)data, size, 0, (sockaddr*)&address, sizeof(address)) == size;
+}
+
+int UdpSocket::receive(uint8_t* buffer, int capacity, NetAddress* from) {
+  sockaddr_in address;
+  socklen_t size = sizeof(address);
+  int received = recvfrom(handle, (char*)buffer, capacity, 0, (sockaddr*)&address, &size);
+  if (received < 0) {
+    return -1;
+  }
+  from->ip = ntohl(address.sin_addr.s_addr);
+  from->port = ntohs(address.sin_port);
+  return received;
+}
+
+NetLink::NetLink(UdpSocket* socket, const NetAddress& peer, const LinkConditions& conditions, uint64_t seed)
+    : socket(socket), peerAddress(peer), conditions(conditions) {
+  seedRandom(&rng, seed);
+}
+
+void NetLink::send(const uint8_t* data, int size, double now) {
+  if (conditions.loss > 0 && randomBelow(&rng, 1000000) < conditions.loss * 1000000) {
+    return;
+  }
+  double delay = conditions.delay;
+  if (conditions.jitter > 0) {
+    delay += conditions.jitter * (randomBelow(&rng, 2001) / 1000.0 - 1);
+  }
+  if (delay <= 0) {
+    socket->send(peerAddress, data, size);
+    return;
+  }
+  delayed.push_back({now + delay, std::vector<uint8_t>(data, data + size)});
+}
+
+void NetLink::flush(double now) {
+  // Sent in the order they're due, which is how jitter reorders them
+  std::stable_sort(delayed.begin(), delayed.end(),
+    [](const DelayedPacket& a, const DelayedPacket& b) { return a.sendTime < b.sendTime; });
+  size_t due = 0;
+  while (due < delayed.size() && delayed[due].sendTime <= now) {
+    socket->send(peerAddress, delayed[due].data.data(), int(delayed[due].data.size()));
+    ++due;
+  }
+  delayed.erase(delayed.begin(), delayed.begin() + due);
+}
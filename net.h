@@ -0,0 +1,81 @@
+#ifndef NET_H
+#define NET_H
+
+#include <stdint.h>
+#include <vector>
+#include "rng.h"
+
+// Thin UDP layer over Winsock or BSD sockets, IPv4 only
+
+struct NetAddress {
+  uint32_t ip = 0; // Host byte order
+  uint16_t port = 0;
+};
+
+inline bool operator==(const NetAddress& a, const NetAddress& b) { return a.ip == b.ip && a.port == b.port; }
+
+// Little endian integers in packets
+inline void writeU32(uint8_t* out, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    out[i] = uint8_t(value >> (8 * i));
+  }
+}
+
+inline uint32_t readU32(const uint8_t* in) {
+  return in[0] | in[1] << 8 | in[2] << 16 | uint32_t(in[3]) << 24;
+}
+
+// Looks up a host name or dotted address
+bool resolveAddress(const char* host, uint16_t port, NetAddress* address);
+
+// A non-blocking UDP socket
+class UdpSocket {
+public:
+  UdpSocket();
+  ~UdpSocket();
+  // Binds to the port on every interface, 0 picks any free port
+  bool open(uint16_t port);
+  bool isOpen() const;
+  uint16_t localPort() const;
+  // The SOCKET or file descriptor, for waiting on it alongside other things
+  intptr_t nativeHandle() const { return handle; }
+  bool send(const NetAddress& to, const uint8_t* data, int size);
+  // Returns the size of the next waiting packet, or -1 if there isn't one
+  int receive(uint8_t* buffer, int capacity, NetAddress* from);
+
+private:
+  void closeHandle();
+
+  intptr_t handle; // SOCKET or file descriptor
+};
+
+// Bad network conditions to put sent packets through when testing, times in milliseconds
+struct LinkConditions {
+  float loss = 0.0f; // Fraction of packets dropped
+  float delay = 0.0f; // Added to every packet
+  float jitter = 0.0f; // Each packet's delay is off by up to this much either way, so they can arrive out of order
+};
+
+// Sends packets to one peer, holding them back or dropping them like a bad network would
+class NetLink {
+public:
+  NetLink(UdpSocket* socket, const NetAddress& peer, const LinkConditions& conditions, uint64_t seed);
+  const NetAddress& peer() const { return peerAddress; }
+  void send(const uint8_t* data, int size, double now);
+  // Sends the held back packets whose time has come
+  void flush(double now);
+
+private:
+  struct DelayedPacket {
+    double sendTime;
+    std::vector<uint8_t> data;
+  };
+
+  UdpSocket* socket;
+  NetAddress peerAddress;
+  LinkConditions conditions;
+  Rng rng;
+  std::vector<DelayedPacket> delayed;
+};
+
+#endif
@@ -1,2 +1,4 @@
 @ECHO OFF
-g++ -Isrc/Include -Lsrc/lib -o pong main.cpp -lmingw32 -lSDL2main -lSDL2 -lSDL2_ttf -lSDL2_mixer
\ No newline at end of file
+g++ -std=c++17 -Isrc/Include -Lsrc/lib -o pong main.cpp ai_controller.cpp env.cpp event_sim.cpp frame_pacer.cpp game.cpp net.cpp render_queue.cpp replay.cpp rollback.cpp server_client.cpp server_protocol.cpp shared_buffers.cpp -lmingw32 -lSDL2main -lSDL2 -lSDL2_ttf -lSDL2_mixer -lws2_32
+g++ -std=c++17 -O2 -o pong-batch ai_controller.cpp batch.cpp event_sim.cpp game.cpp
+g++ -std=c++17 -O2 -shared -o pong_env.dll ai_controller.cpp env.cpp game.cpp pong_env.cpp
\ No newline at end of file
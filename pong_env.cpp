@@ -0,0 +1,70 @@
+#include "pong_env.h"
+#include <string.h>
+#include <new>
+#include <stdexcept>
+#include "env.h"
+
+struct PongEnv {
+  VectorEnv env;
+  explicit PongEnv(int matches) : env(matches) {}
+};
+
+static void copyRow(const std::vector<Real>& values, float* row) {
+  for (size_t i = 0; i < values.size(); ++i) {
+    row[i] = float(values[i]);
+  }
+}
+
+static void copyObservations(const VectorEnv& env, float* observations) {
+  const AiObservations& observed = env.observations();
+  int matches = env.size();
+  copyRow(observed.paddleY, observations + PONG_ENV_PADDLE_Y * matches);
+  copyRow(observed.opponentY, observations + PONG_ENV_OPPONENT_Y * matches);
+  copyRow(observed.ballX, observations + PONG_ENV_BALL_X * matches);
+  copyRow(observed.ballY, observations + PONG_ENV_BALL_Y * matches);
+  copyRow(observed.ballVelX, observations + PONG_ENV_BALL_VEL_X * matches);
+  copyRow(observed.ballVelY, observations + PONG_ENV_BALL_VEL_Y * matches);
+  float* inPlay = observations + PONG_ENV_BALL_IN_PLAY * matches;
+  for (int i = 0; i < matches; ++i) {
+    inPlay[i] = observed.ballInPlay[i];
+  }
+}
+
+PongEnv* pong_env_create(int matches) {
+  if (matches <= 0) {
+    return NULL;
+  }
+  // Exceptions can't cross into C callers, so running out of memory is reported as NULL
+  try {
+    return new PongEnv(matches);
+  } catch (const std::bad_alloc&) {
+    return NULL;
+  } catch (const std::length_error&) {
+    return NULL;
+  }
+}
+
+void pong_env_destroy(PongEnv* env) {
+  delete env;
+}
+
+void pong_env_reset(PongEnv* env, const uint64_t* seeds, float* observations) {
+  env->env.reset(seeds);
+  if (observations) {
+    copyObservations(env->env, observations);
+  }
+}
+
+void pong_env_step(PongEnv* env, const uint8_t* actions, float* observations, float* rewards, uint8_t* dones) {
+  env->env.step(actions);
+  int matches = env->env.size();
+  if (observations) {
+    copyObservations(env->env, observations);
+  }
+  if (rewards) {
+    memcpy(rewards, env->env.rewards(), matches * sizeof(float));
+  }
+  if (dones) {
+    memcpy(dones, env->env.dones(), matches * sizeof(uint8_t));
+  }
+}
@@ -0,0 +1,48 @@
+#ifndef PONG_ENV_H
+#define PONG_ENV_H
+
+/* C interface to VectorEnv for training code in other languages, build it into a shared
+   library with pong_env.cpp. Arrays hold one entry per match. Observations are structure of
+   arrays: PONG_ENV_OBSERVATION_FIELDS rows of one float per match, in PongEnvObservation order.
+   Coordinates are pixels mirrored so the policy's paddle is on the right, see AiObservations. */
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#define PONG_ENV_API __declspec(dllexport)
+#else
+#define PONG_ENV_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct PongEnv PongEnv;
+
+enum PongEnvObservation {
+  PONG_ENV_PADDLE_Y,
+  PONG_ENV_OPPONENT_Y,
+  PONG_ENV_BALL_X,
+  PONG_ENV_BALL_Y,
+  PONG_ENV_BALL_VEL_X,
+  PONG_ENV_BALL_VEL_Y,
+  PONG_ENV_BALL_IN_PLAY,
+  PONG_ENV_OBSERVATION_FIELDS
+};
+
+/* Actions are 0 to stay, 1 to move up and 2 to move down */
+/* Returns NULL if matches isn't positive or there isn't the memory for them. Everything is
+   allocated here, so the other calls never fail. */
+PONG_ENV_API PongEnv* pong_env_create(int matches);
+PONG_ENV_API void pong_env_destroy(PongEnv* env);
+/* Any of the output arrays may be NULL, observations needs PONG_ENV_OBSERVATION_FIELDS * matches floats */
+PONG_ENV_API void pong_env_reset(PongEnv* env, const uint64_t* seeds, float* observations);
+PONG_ENV_API void pong_env_step(PongEnv* env, const uint8_t* actions, float* observations,
+  float* rewards, uint8_t* dones);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
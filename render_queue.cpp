@@ -0,0 +1,116 @@
+#include "render_queue.h"
+#include <algorithm>
+
+// Packs a color so it can be compared and sorted as one number
+static Uint32 packColor(SDL_Color color) {
+  return (Uint32(color.r) << 24) | (Uint32(color.g) << 16) | (Uint32(color.b) << 8) | color.a;
+}
+
+void RenderQueue::fillRect(const SDL_FRect& rect, SDL_Color color, int layer) {
+  commands.push_back({layer, NULL, color, {0, 0, 0, 0}, rect});
+}
+
+void RenderQueue::copy(SDL_Texture* texture, const SDL_Rect* source, const SDL_FRect& dest,
+    SDL_Color color, int layer) {
+  SDL_Rect fullSource {0, 0, 0, 0};
+  if (!source) {
+    SDL_QueryTexture(texture, NULL, NULL, &fullSource.w, &fullSource.h);
+    source = &fullSource;
+  }
+  commands.push_back({layer, texture, color, *source, dest});
+}
+
+void RenderQueue::flush(SDL_Renderer* renderer) {
+  lastStats = RenderStats();
+  lastStats.commands = commands.size();
+  // The renderer's state may have been changed by code outside of the queue
+  drawColorKnown = false;
+  boundTexture = NULL;
+
+  std::stable_sort(commands.begin(), commands.end(),
+    [](const RenderCommand& a, const RenderCommand& b) {
+      if (a.layer != b.layer) return a.layer < b.layer;
+      if (a.texture != b.texture) return a.texture < b.texture;
+      return packColor(a.color) < packColor(b.color);
+    });
+
+  // Submit each run of commands sharing a layer, texture, and color together
+  size_t begin = 0;
+  while (begin < commands.size()) {
+    const RenderCommand& first = commands[begin];
+    size_t end = begin + 1;
+    while (end < commands.size() &&
+      commands[end].layer == first.layer &&
+      commands[end].texture == first.texture &&
+      packColor(commands[end].color) == packColor(first.color)) {
+      ++end;
+    }
+    if (first.texture) {
+      flushCopies(renderer, begin, end);
+    } else {
+      flushRects(renderer, begin, end);
+    }
+    begin = end;
+  }
+  commands.clear();
+}
+
+void RenderQueue::flushRects(SDL_Renderer* renderer, size_t begin, size_t end) {
+  SDL_Color color = commands[begin].color;
+  if (!drawColorKnown || packColor(drawColor) != packColor(color)) {
+    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
+    drawColor = color;
+    drawColorKnown = true;
+    ++lastStats.stateChanges;
+  }
+  rectBatch.clear();
+  for (size_t i = begin; i < end; ++i) {
+    rectBatch.push_back(commands[i].dest);
+  }
+  SDL_RenderFillRectsF(renderer, rectBatch.data(), rectBatch.size());
+  ++lastStats.drawCalls;
+}
+
+void RenderQueue::flushCopies(SDL_Renderer* renderer, size_t begin, size_t end) {
+  SDL_Texture* texture = commands[begin].texture;
+  SDL_Color color = commands[begin].color;
+  bool stateChanged = texture != boundTexture || packColor(color) != packColor(boundColor);
+  boundTexture = texture;
+  boundColor = color;
+  if (stateChanged) {
+    ++lastStats.stateChanges;
+  }
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+  // Every quad using this texture and color goes out as a single geometry call
+  int textureWidth, textureHeight;
+  SDL_QueryTexture(texture, NULL, NULL, &textureWidth, &textureHeight);
+  vertexBatch.clear();
+  indexBatch.clear();
+  for (size_t i = begin; i < end; ++i) {
+    const SDL_Rect& src = commands[i].source;
+    const SDL_FRect& dst = commands[i].dest;
+    float u0 = float(src.x) / textureWidth, u1 = float(src.x + src.w) / textureWidth;
+    float v0 = float(src.y) / textureHeight, v1 = float(src.y + src.h) / textureHeight;
+    int first = vertexBatch.size();
+    vertexBatch.push_back({{dst.x, dst.y}, color, {u0, v0}});
+    vertexBatch.push_back({{dst.x + dst.w, dst.y}, color, {u1, v0}});
+    vertexBatch.push_back({{dst.x + dst.w, dst.y + dst.h}, color, {u1, v1}});
+    vertexBatch.push_back({{dst.x, dst.y + dst.h}, color, {u0, v1}});
+    int quad[6] = {first, first + 1, first + 2, first, first + 2, first + 3};
+    indexBatch.insert(indexBatch.end(), quad, quad + 6);
+  }
+  SDL_RenderGeometry(renderer, texture, vertexBatch.data(), vertexBatch.size(),
+    indexBatch.data(), indexBatch.size());
+  ++lastStats.drawCalls;
+#else
+  // Without SDL_RenderGeometry each quad is its own copy, but the color mod is only set once
+  if (stateChanged) {
+    SDL_SetTextureColorMod(texture, color.r, color.g, color.b);
+    SDL_SetTextureAlphaMod(texture, color.a);
+  }
+  for (size_t i = begin; i < end; ++i) {
+    SDL_RenderCopyF(renderer, texture, &commands[i].source, &commands[i].dest);
+    ++lastStats.drawCalls;
+  }
+#endif
+}
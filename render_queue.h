@@ -0,0 +1,52 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <SDL2/SDL.h>
+#include <vector>
+
+// Draw calls and renderer state changes made by the last flush
+struct RenderStats {
+  int commands = 0;
+  int drawCalls = 0;
+  int stateChanges = 0;
+};
+
+// One rect to draw, solid if texture is NULL, otherwise copied from source in the texture
+struct RenderCommand {
+  int layer;
+  SDL_Texture* texture;
+  SDL_Color color;
+  SDL_Rect source;
+  SDL_FRect dest;
+};
+
+// Collects everything drawn in a frame and submits it in as few batched calls as possible.
+// Commands are grouped by layer, then texture, then color, so only lower layers are
+// guaranteed to be drawn beneath higher ones.
+class RenderQueue {
+public:
+  void fillRect(const SDL_FRect& rect, SDL_Color color, int layer = 1);
+  void copy(SDL_Texture* texture, const SDL_Rect* source, const SDL_FRect& dest,
+    SDL_Color color = {255, 255, 255, 255}, int layer = 1);
+  // Sorts and draws every queued command then empties the queue
+  void flush(SDL_Renderer* renderer);
+  const RenderStats& stats() const { return lastStats; }
+
+private:
+  void flushRects(SDL_Renderer* renderer, size_t begin, size_t end);
+  void flushCopies(SDL_Renderer* renderer, size_t begin, size_t end);
+
+  std::vector<RenderCommand> commands;
+  std::vector<SDL_FRect> rectBatch;
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+  std::vector<SDL_Vertex> vertexBatch;
+  std::vector<int> indexBatch;
+#endif
+  RenderStats lastStats;
+  SDL_Color drawColor;
+  bool drawColorKnown = false;
+  SDL_Texture* boundTexture = NULL;
+  SDL_Color boundColor;
+};
+
+#endif
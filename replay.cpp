@@ -0,0 +1,146 @@
+#include "replay.h"
+#include "game.h"
+
+ReplayWriter::ReplayWriter(const char* path, uint64_t seed, uint8_t flags) : file(path, std::ios::binary) {
+  if (!file.is_open()) {
+    return;
+  }
+  file.write("PONG", 4);
+  file.put(REPLAY_VERSION);
+  file.put(flags);
+  writeVarint(seed);
+}
+
+ReplayWriter::~ReplayWriter() {
+  if (file.is_open()) {
+    finish(lastTick);
+  }
+}
+
+void ReplayWriter::recordInput(uint32_t tick, uint8_t input) {
+  if (!file.is_open() || input == lastInput) {
+    return;
+  }
+  writeTick(tick);
+  file.put(input);
+  lastInput = input;
+}
+
+void ReplayWriter::recordChecksum(uint32_t tick, uint32_t checksum) {
+  if (!file.is_open()) {
+    return;
+  }
+  writeTick(tick);
+  file.put(REPLAY_CHECKSUM);
+  for (int i = 0; i < 4; ++i) {
+    file.put(char(checksum >> (i * 8)));
+  }
+}
+
+void ReplayWriter::finish(uint32_t tick) {
+  if (!file.is_open()) {
+    return;
+  }
+  writeTick(tick);
+  file.put(REPLAY_END);
+  file.close();
+}
+
+void ReplayWriter::writeTick(uint32_t tick) {
+  writeVarint(tick - lastTick);
+  lastTick = tick;
+}
+
+// Seven bits at a time with the high bit set on every byte but the last
+void ReplayWriter::writeVarint(uint64_t value) {
+  while (value >= 0x80) {
+    file.put(char(value | 0x80));
+    value >>= 7;
+  }
+  file.put(char(value));
+}
+
+ReplayReader::ReplayReader(const char* path) : file(path, std::ios::binary) {
+  char magic[4];
+  if (!file.read(magic, 4) || magic[0] != 'P' || magic[1] != 'O' || magic[2] != 'N' || magic[3] != 'G') {
+    return;
+  }
+  int version = file.get();
+  if (version < REPLAY_OLDEST_VERSION || version > REPLAY_VERSION) {
+    return;
+  }
+  int flags = file.get();
+  if (flags == EOF) {
+    return;
+  }
+  replayFlags = flags;
+  if (!readVarint(&replaySeed)) {
+    return;
+  }
+  valid = true;
+  readNextRecord();
+}
+
+bool ReplayReader::finished(uint32_t tick) const {
+  return nextInput == REPLAY_END && tick >= nextTick;
+}
+
+uint8_t ReplayReader::inputFor(uint32_t tick) {
+  while (nextInput != REPLAY_END && tick >= nextTick) {
+    if (nextInput == REPLAY_CHECKSUM) {
+      hasChecksum = true;
+      checksumTick = nextTick;
+      checksum = nextChecksum;
+    } else {
+      currentInput = nextInput;
+    }
+    readNextRecord();
+  }
+  return currentInput;
+}
+
+bool ReplayReader::checksumFor(uint32_t tick, uint32_t* checksum) const {
+  if (!hasChecksum || checksumTick != tick) {
+    return false;
+  }
+  *checksum = this->checksum;
+  return true;
+}
+
+bool ReplayReader::readVarint(uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int byte = file.get();
+    if (byte == EOF) {
+      return false;
+    }
+    *value |= uint64_t(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// A file cut short, like from the game crashing, ends at the last complete record
+void ReplayReader::readNextRecord() {
+  uint64_t delta;
+  int input = EOF;
+  if (readVarint(&delta)) {
+    input = file.get();
+  }
+  if (input == REPLAY_CHECKSUM) {
+    nextChecksum = 0;
+    for (int i = 0; i < 4 && input != EOF; ++i) {
+      int byte = file.get();
+      nextChecksum |= uint32_t(byte) << (i * 8);
+      if (byte == EOF) input = EOF;
+    }
+  }
+  if (input == EOF) {
+    nextInput = REPLAY_END;
+    return;
+  }
+  nextTick += delta;
+  nextInput = input;
+}
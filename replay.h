@@ -0,0 +1,81 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <fstream>
+
+// A replay is the match's seed followed by every change in input and the step it happened on.
+// Steps are stored as the distance from the previous record and packed as varints, so a full
+// match is usually a few kilobytes. It can also hold hashes of the game state every so many
+// steps so playing it back can tell exactly where the simulation stopped matching.
+//
+// File layout:
+//   "PONG" then a version byte
+//   SimulationFlags saying how the simulation was built, since float and fixed point builds
+//     or libm and table trig play the same inputs out differently
+//   seed as a varint
+//   records, each starting with the steps since the previous record as a varint then either
+//     an input byte for an input change
+//     REPLAY_CHECKSUM then the 4 byte little endian hash of the state at the start of the step
+//   a final record of REPLAY_END
+
+const uint8_t REPLAY_VERSION = 4;
+// Earlier versions were recorded while the right AI chased the ball and can't be played back
+const uint8_t REPLAY_OLDEST_VERSION = 4;
+const uint8_t REPLAY_CHECKSUM = 0xFE; // Never a valid input
+const uint8_t REPLAY_END = 0xFF;
+
+class ReplayWriter {
+public:
+  // Check isOpen afterwards to know if the file could be created
+  ReplayWriter(const char* path, uint64_t seed, uint8_t flags);
+  ~ReplayWriter();
+  bool isOpen() const { return file.is_open(); }
+  // Call with every step's input in order, only changes are written
+  void recordInput(uint32_t tick, uint8_t input);
+  // Call before the step's input to save the hash of the state at the start of the step
+  void recordChecksum(uint32_t tick, uint32_t checksum);
+  // Marks the step the replay stops at and closes the file
+  void finish(uint32_t tick);
+
+private:
+  void writeVarint(uint64_t value);
+  void writeTick(uint32_t tick);
+
+  std::ofstream file;
+  uint32_t lastTick = 0;
+  uint8_t lastInput = 0;
+};
+
+class ReplayReader {
+public:
+  // Check isOpen afterwards to know if the file could be read
+  explicit ReplayReader(const char* path);
+  bool isOpen() const { return valid; }
+  uint64_t seed() const { return replaySeed; }
+  uint8_t flags() const { return replayFlags; }
+  // True once every step of the replay has been played
+  bool finished(uint32_t tick) const;
+  // Call with every step in order starting from 0 to get the input for it
+  uint8_t inputFor(uint32_t tick);
+  // After inputFor, gets the hash saved for the state at the start of the step if there is one
+  bool checksumFor(uint32_t tick, uint32_t* checksum) const;
+
+private:
+  bool readVarint(uint64_t* value);
+  void readNextRecord();
+
+  std::ifstream file;
+  bool valid = false;
+  uint64_t replaySeed = 0;
+  uint8_t replayFlags = 0;
+  uint8_t currentInput = 0;
+  uint32_t nextTick = 0;
+  uint8_t nextInput = REPLAY_END; // Or REPLAY_CHECKSUM with the hash in nextChecksum
+  uint32_t nextChecksum = 0;
+  bool hasChecksum = false;
+  uint32_t checksumTick = 0;
+  uint32_t checksum = 0;
+};
+
+#endif
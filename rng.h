@@ -0,0 +1,34 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// PCG32 random number generator (pcg-random.org). Every match carries its own so matches
+// can be replayed from their seed and simulated on separate threads.
+struct Rng {
+  uint64_t state = 0;
+  uint64_t increment = 1; // Must be odd
+};
+
+inline uint32_t nextRandom(Rng* rng) {
+  uint64_t oldState = rng->state;
+  rng->state = oldState * 6364136223846793005ULL + rng->increment;
+  uint32_t xorShifted = uint32_t(((oldState >> 18u) ^ oldState) >> 27u);
+  uint32_t rotation = uint32_t(oldState >> 59u);
+  return (xorShifted >> rotation) | (xorShifted << ((-rotation) & 31));
+}
+
+inline void seedRandom(Rng* rng, uint64_t seed, uint64_t stream = 0) {
+  rng->state = 0;
+  rng->increment = (stream << 1u) | 1u;
+  nextRandom(rng);
+  rng->state += seed;
+  nextRandom(rng);
+}
+
+// Returns a number from 0 up to but not including bound
+inline uint32_t randomBelow(Rng* rng, uint32_t bound) {
+  return uint32_t((uint64_t(nextRandom(rng)) * bound) >> 32);
+}
+
+#endif
@@ -0,0 +1,276 @@
+#include "rollback.h"
+#include <string.h>
+#include <algorithm>
+
+enum PacketType : uint8_t {
+  PACKET_HELLO = 1, // Joining side to host: protocol version, SimulationFlags
+  PACKET_WELCOME = 2, // Host to joining side: protocol version, SimulationFlags, seed
+  PACKET_INPUTS = 3, // Acknowledged tick, first tick, count, inputs, checksum tick, checksum, advantage
+  PACKET_REFUSED = 4 // Host to joining side that can't play with it: protocol version, SimulationFlags
+};
+
+const double HANDSHAKE_RESEND = 100.0; // Milliseconds between hellos until the host answers
+const double INPUT_RESEND = 20.0; // Most milliseconds to go without sending inputs
+const int MAX_PACKET_SIZE = 512;
+
+RollbackSession::RollbackSession(UdpSocket* socket, uint64_t seed, const LinkConditions& conditions)
+    : socket(socket), conditions(conditions), hosting(true), seed(seed) {
+  memset(remoteInputTicks, 0xFF, sizeof(remoteInputTicks));
+  memset(checksumTicks, 0xFF, sizeof(checksumTicks));
+}
+
+RollbackSession::RollbackSession(UdpSocket* socket, const NetAddress& host, const LinkConditions& conditions)
+    : socket(socket), conditions(conditions), hostAddress(host), hosting(false) {
+  memset(remoteInputTicks, 0xFF, sizeof(remoteInputTicks));
+  memset(checksumTicks, 0xFF, sizeof(checksumTicks));
+  link.reset(new NetLink(socket, host, conditions, host.port));
+}
+
+void RollbackSession::poll(double now) {
+  uint8_t packet[MAX_PACKET_SIZE];
+  NetAddress from;
+  int size;
+  while ((size = socket->receive(packet, sizeof(packet), &from)) >= 0) {
+    receive(packet, size, from, now);
+  }
+  if (started) {
+    rollBack();
+    updateChecksums();
+  }
+
+  if (link && !started && !wasRefused && now - lastSend >= HANDSHAKE_RESEND) {
+    sendHandshake(PACKET_HELLO, now);
+  } else if (started && now - lastSend >= INPUT_RESEND) {
+    sendInputs(now); // Nothing's been stepped lately, the other side may still need ours
+  }
+  if (link) {
+    link->flush(now);
+  }
+}
+
+void RollbackSession::receive(const uint8_t* packet, int size, const NetAddress& from, double now) {
+  if (size < 3) {
+    return;
+  }
+  bool compatible = packet[1] == NET_PROTOCOL_VERSION && packet[2] == SIMULATION_FLAGS;
+  if (packet[0] == PACKET_HELLO && hosting && !compatible) {
+    // Told what this side is so they can say why they couldn't join, the game stays open
+    uint8_t refusal[3] = {PACKET_REFUSED, NET_PROTOCOL_VERSION, SIMULATION_FLAGS};
+    socket->send(from, refusal, sizeof(refusal));
+  } else if (packet[0] == PACKET_HELLO && hosting && compatible) {
+    // The first to say hello gets the game, their hello is answered until inputs come back
+    if (!link) {
+      link.reset(new NetLink(socket, from, conditions, seed ^ from.port));
+      initGame(&game, seed);
+      game.player2Ai = false;
+      started = true;
+    }
+    if (link->peer() == from) {
+      sendHandshake(PACKET_WELCOME, now);
+    }
+  } else if (packet[0] == PACKET_WELCOME && !hosting && !started && size >= 11 && compatible &&
+      from == hostAddress) {
+    seed = uint64_t(readU32(packet + 3)) | uint64_t(readU32(packet + 7)) << 32;
+    initGame(&game, seed);
+    game.player2Ai = false;
+    started = true;
+  } else if (packet[0] == PACKET_REFUSED && !hosting && !started && from == hostAddress) {
+    wasRefused = true;
+    hostVersion = packet[1];
+    hostFlags = packet[2];
+  } else if (packet[0] == PACKET_INPUTS && started && from == link->peer()) {
+    receiveInputs(packet, size);
+  }
+}
+
+void RollbackSession::receiveInputs(const uint8_t* packet, int size) {
+  if (size < 10) {
+    return;
+  }
+  uint32_t acknowledged = readU32(packet + 1);
+  uint32_t first = readU32(packet + 5);
+  int count = packet[9];
+  if (size < 10 + count + 9) {
+    return;
+  }
+  peerAcknowledged = std::max(peerAcknowledged, std::min(acknowledged, currentTick));
+  for (int i = 0; i < count; ++i) {
+    uint32_t tick = first + i;
+    if (tick < remoteConfirmed || tick >= remoteConfirmed + ROLLBACK_WINDOW) {
+      continue;
+    }
+    int slot = tick % ROLLBACK_WINDOW;
+    uint8_t input = packet[10 + i];
+    remoteInputs[slot] = input;
+    remoteInputTicks[slot] = tick;
+    if (tick < currentTick && usedRemoteInputs[slot] != input) {
+      rollbackFrom = std::min(rollbackFrom, tick);
+    }
+  }
+  while (remoteInputTicks[remoteConfirmed % ROLLBACK_WINDOW] == remoteConfirmed) {
+    ++remoteConfirmed;
+  }
+  // Packets can arrive out of order, only a newer checksum replaces the one held
+  uint32_t checksumTick = readU32(packet + 10 + count);
+  if (checksumTick != UINT32_MAX && (peerChecksumTick == UINT32_MAX || checksumTick > peerChecksumTick)) {
+    peerChecksumTick = checksumTick;
+    peerChecksum = readU32(packet + 14 + count);
+  }
+  float advantage = int8_t(packet[18 + count]);
+  remoteAdvantage = heardAdvantage ? remoteAdvantage + (advantage - remoteAdvantage) * TIME_SYNC_SMOOTHING : advantage;
+  heardAdvantage = true;
+}
+
+void RollbackSession::sendHandshake(uint8_t type, double now) {
+  uint8_t packet[11] = {type, NET_PROTOCOL_VERSION, SIMULATION_FLAGS};
+  writeU32(packet + 3, uint32_t(seed));
+  writeU32(packet + 7, uint32_t(seed >> 32));
+  link->send(packet, type == PACKET_WELCOME ? 11 : 3, now);
+  lastSend = now;
+}
+
+void RollbackSession::sendInputs(double now) {
+  // Everything the other side hasn't acknowledged, which stays inside the window since neither
+  // side can get more than MAX_PREDICTED_STEPS past the other's inputs
+  uint32_t first = std::max(peerAcknowledged, currentTick > ROLLBACK_WINDOW ? currentTick - ROLLBACK_WINDOW : 0);
+  int count = std::min(int(currentTick - first), 255);
+  uint8_t packet[10 + 255 + 9];
+  packet[0] = PACKET_INPUTS;
+  writeU32(packet + 1, remoteConfirmed);
+  writeU32(packet + 5, first);
+  packet[9] = uint8_t(count);
+  for (int i = 0; i < count; ++i) {
+    packet[10 + i] = localInputs[(first + i) % ROLLBACK_WINDOW];
+  }
+  // The newest checksum we have
+  uint32_t checksumTick = UINT32_MAX, checksum = 0;
+  for (int i = 0; i < CHECKSUMS_KEPT; ++i) {
+    if (checksumTicks[i] != UINT32_MAX && (checksumTick == UINT32_MAX || checksumTicks[i] > checksumTick)) {
+      checksumTick = checksumTicks[i];
+      checksum = checksums[i];
+    }
+  }
+  writeU32(packet + 10 + count, checksumTick);
+  writeU32(packet + 14 + count, checksum);
+  // How far this side has got past the other's inputs. The other side's delay adds the same to
+  // both sides' figures, so half the difference between them is how far apart their ticks are.
+  int advantage = std::min(127, std::max(-127, int(currentTick) - int(remoteConfirmed)));
+  localAdvantage += (advantage - localAdvantage) * TIME_SYNC_SMOOTHING;
+  packet[18 + count] = uint8_t(int8_t(advantage));
+  link->send(packet, 19 + count, now);
+  lastSend = now;
+}
+
+void RollbackSession::simulate(uint32_t tick) {
+  int slot = tick % ROLLBACK_WINDOW;
+  states[slot] = game;
+  uint8_t remote;
+  if (tick < remoteConfirmed) {
+    remote = remoteInputs[slot];
+  } else if (remoteConfirmed > 0) {
+    remote = remoteInputs[(remoteConfirmed - 1) % ROLLBACK_WINDOW]; // Guess it hasn't changed
+  } else {
+    remote = 0;
+  }
+  usedRemoteInputs[slot] = remote;
+  uint8_t left = hosting ? localInputs[slot] : remote;
+  uint8_t right = hosting ? remote : localInputs[slot];
+  game.soundEvents = 0;
+  game.ballTeleported = false;
+  stepGame(&game, left | right << 2, SIMULATION_STEP);
+}
+
+void RollbackSession::rollBack() {
+  if (rollbackFrom >= currentTick) {
+    rollbackFrom = UINT32_MAX;
+    return;
+  }
+  game = states[rollbackFrom % ROLLBACK_WINDOW];
+  for (uint32_t tick = rollbackFrom; tick < currentTick; ++tick) {
+    simulate(tick);
+  }
+  int depth = currentTick - rollbackFrom;
+  ++sessionStats.rollbacks;
+  sessionStats.resimulatedSteps += depth;
+  sessionStats.deepestRollback = std::max(sessionStats.deepestRollback, depth);
+  rollbackFrom = UINT32_MAX;
+}
+
+void RollbackSession::updateChecksums() {
+  // States up to the last step both sides have the inputs for are final
+  uint32_t finalTick = std::min(remoteConfirmed, currentTick);
+  while (nextChecksumTick <= finalTick) {
+    uint32_t tick = nextChecksumTick;
+    const GameState& state = tick == currentTick ? game : states[tick % ROLLBACK_WINDOW];
+    int slot = (tick / NET_CHECKSUM_INTERVAL) % CHECKSUMS_KEPT;
+    checksumTicks[slot] = tick;
+    checksums[slot] = hashGameState(&state);
+    nextChecksumTick += NET_CHECKSUM_INTERVAL;
+  }
+  compareChecksums();
+}
+
+void RollbackSession::compareChecksums() {
+  if (peerChecksumTick == UINT32_MAX || (lastComparedTick != UINT32_MAX && peerChecksumTick <= lastComparedTick)) {
+    return;
+  }
+  int slot = (peerChecksumTick / NET_CHECKSUM_INTERVAL) % CHECKSUMS_KEPT;
+  if (checksumTicks[slot] != peerChecksumTick) {
+    return; // Not there yet, or too long ago
+  }
+  lastComparedTick = peerChecksumTick;
+  if (checksums[slot] == peerChecksum) {
+    ++sessionStats.checksumsMatched;
+  } else {
+    sessionStats.desynced = true;
+  }
+}
+
+bool RollbackSession::aheadOfPeer() {
+  if (!heardAdvantage) {
+    return false;
+  }
+  sessionStats.frameAdvantage = (localAdvantage - remoteAdvantage) / 2;
+  // The averages lag behind, so once a gap is measured it's made up in full, then they're left
+  // to catch up before measuring again rather than chasing a gap that's already closed
+  if (syncWaitsLeft == 0 && currentTick >= nextSyncCheck && sessionStats.frameAdvantage >= 1.0f) {
+    syncWaitsLeft = int(sessionStats.frameAdvantage);
+  }
+  // Spread out so each wait is too short to notice
+  if (syncWaitsLeft == 0 || currentTick < lastSyncWait + TIME_SYNC_INTERVAL) {
+    return false;
+  }
+  if (--syncWaitsLeft == 0) {
+    nextSyncCheck = currentTick + TIME_SYNC_SETTLE;
+  }
+  return true;
+}
+
+bool RollbackSession::advance(uint8_t paddleInput, double now) {
+  if (!connected()) {
+    return false;
+  }
+  if (currentTick >= remoteConfirmed + MAX_PREDICTED_STEPS) {
+    ++sessionStats.stalls;
+    return false;
+  }
+  if (aheadOfPeer()) {
+    ++sessionStats.syncWaits;
+    lastSyncWait = currentTick;
+    return false;
+  }
+  localInputs[currentTick % ROLLBACK_WINDOW] = paddleInput & INPUT_LEFT_MASK;
+  simulate(currentTick);
+  soundEvents |= game.soundEvents;
+  ++currentTick;
+  updateChecksums();
+  sendInputs(now);
+  link->flush(now);
+  return true;
+}
+
+int RollbackSession::takeSoundEvents() {
+  int events = soundEvents;
+  soundEvents = 0;
+  return events;
+}
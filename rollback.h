@@ -0,0 +1,121 @@
+#ifndef ROLLBACK_H
+#define ROLLBACK_H
+
+#include <memory>
+#include "game.h"
+#include "net.h"
+
+// Online play where both sides run the whole simulation. The local paddle's input is used on
+// the step it's pressed, the other paddle's is guessed to stay whatever it last was, and when
+// the real input arrives and differs the game is put back to the state saved for that step and
+// played forward again. Only inputs are ever sent, each packet repeating every one the other
+// side hasn't acknowledged so lost packets don't matter.
+//
+// The host picks the seed and plays the left paddle, the side that joins plays the right.
+//
+// The host starts stepping as soon as the hello arrives and the other side only once the welcome
+// does, so left alone the host would stay ahead by the delay between them and do all the rolling
+// back. Each side sends how far its tick is past the other's inputs, and as with GGPO's time sync
+// the side that's further ahead holds back a step now and then until the two are even.
+
+const int ROLLBACK_WINDOW = 128; // Steps of states and inputs kept
+const int MAX_PREDICTED_STEPS = 60; // How far past the other side's inputs to guess, 0.25 s
+const int NET_CHECKSUM_INTERVAL = 60; // Steps between hashes compared to catch desyncs
+const int TIME_SYNC_INTERVAL = 8; // Fewest steps between steps held back to let the other side catch up
+const int TIME_SYNC_SETTLE = 240; // Steps after catching up before the advantage is trusted again
+const float TIME_SYNC_SMOOTHING = 1.0f / 32; // How far each new advantage moves the running average
+const uint8_t NET_PROTOCOL_VERSION = 2;
+
+struct RollbackStats {
+  long long rollbacks = 0; // Times a wrong guess was corrected
+  long long resimulatedSteps = 0;
+  int deepestRollback = 0; // Most steps played again at once
+  long long stalls = 0; // Steps held back because the other side's inputs were too far behind
+  long long checksumsMatched = 0;
+  bool desynced = false;
+  float frameAdvantage = 0.0f; // Steps this side is ahead of the other, averaged, negative when behind
+  long long syncWaits = 0; // Steps held back so the other side could catch up
+};
+
+class RollbackSession {
+public:
+  // Hosts on the socket, waiting for whoever sends a hello first
+  RollbackSession(UdpSocket* socket, uint64_t seed, const LinkConditions& conditions);
+  // Joins the host at the address
+  RollbackSession(UdpSocket* socket, const NetAddress& host, const LinkConditions& conditions);
+  bool connected() const { return link && started; }
+  // The host is a different protocol version or kind of build, the two below say which
+  bool refused() const { return wasRefused; }
+  uint8_t hostProtocolVersion() const { return hostVersion; }
+  uint8_t hostSimulationFlags() const { return hostFlags; }
+  bool leftSide() const { return hosting; }
+  const GameState& state() const { return game; }
+  uint32_t tick() const { return currentTick; }
+  // Steps up to here have the other side's real input
+  uint32_t confirmedTick() const { return remoteConfirmed; }
+  const RollbackStats& stats() const { return sessionStats; }
+
+  // Reads everything that's arrived and plays the game again from the first wrong guess.
+  // now is in milliseconds from any fixed point, it only times resends and test delays.
+  void poll(double now);
+  // Steps the game with the local paddle's input, INPUT_LEFT_UP or INPUT_LEFT_DOWN whichever
+  // side it's on. Returns false without stepping until connected, while it's guessed as far
+  // ahead as it's allowed to, and for the odd step it holds back to let the other side catch up.
+  bool advance(uint8_t paddleInput, double now);
+  // Sounds raised by steps since the last call, steps played again don't repeat theirs
+  int takeSoundEvents();
+
+private:
+  void receive(const uint8_t* packet, int size, const NetAddress& from, double now);
+  void receiveInputs(const uint8_t* packet, int size);
+  void sendInputs(double now);
+  void sendHandshake(uint8_t type, double now);
+  void simulate(uint32_t tick); // Steps from the state at the start of tick, saving it first
+  void rollBack();
+  void updateChecksums();
+  void compareChecksums();
+  // Whether this side is far enough ahead that it should hold back a step
+  bool aheadOfPeer();
+
+  UdpSocket* socket;
+  LinkConditions conditions;
+  std::unique_ptr<NetLink> link;
+  NetAddress hostAddress;
+  bool hosting;
+  bool started = false;
+  bool wasRefused = false;
+  uint8_t hostVersion = 0, hostFlags = 0;
+  uint64_t seed = 0;
+  double lastSend = -1e9;
+
+  GameState game;
+  int soundEvents = 0;
+  uint32_t currentTick = 0;
+  // Indexed by tick % ROLLBACK_WINDOW
+  GameState states[ROLLBACK_WINDOW]; // At the start of the tick
+  uint8_t localInputs[ROLLBACK_WINDOW];
+  uint8_t remoteInputs[ROLLBACK_WINDOW];
+  uint32_t remoteInputTicks[ROLLBACK_WINDOW]; // Which tick remoteInputs holds, to tell old ones apart
+  uint8_t usedRemoteInputs[ROLLBACK_WINDOW]; // The real or guessed input the step was played with
+  uint32_t remoteConfirmed = 0; // Every remote input before this has arrived
+  uint32_t peerAcknowledged = 0; // Every local input before this has reached the other side
+  uint32_t rollbackFrom = UINT32_MAX;
+
+  // Running averages of how far each side's tick has been past the other's inputs
+  float localAdvantage = 0.0f, remoteAdvantage = 0.0f;
+  bool heardAdvantage = false;
+  int syncWaitsLeft = 0; // Steps still to hold back to even out the last advantage measured
+  uint32_t lastSyncWait = 0;
+  uint32_t nextSyncCheck = 0;
+
+  // Hashes of states neither side can change any more, the last few of ours and the latest of
+  // theirs, compared whenever both have one for the same tick
+  static const int CHECKSUMS_KEPT = 8;
+  uint32_t checksumTicks[CHECKSUMS_KEPT], checksums[CHECKSUMS_KEPT];
+  uint32_t nextChecksumTick = 0;
+  uint32_t peerChecksumTick = UINT32_MAX, peerChecksum = 0;
+  uint32_t lastComparedTick = UINT32_MAX;
+  RollbackStats sessionStats;
+};
+
+#endif
@@ -0,0 +1,825 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <iomanip>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+#include "game.h"
+#include "net.h"
+#include "server_protocol.h"
+
+// Hosts many matches in one process. The main thread owns the UDP socket and waits on it and a
+// 120 Hz timer with epoll, handing the inputs that arrive to a fixed pool of simulation workers.
+// Every match belongs to one worker, picked by its id, and only that worker ever touches it, so
+// a tick needs no locks beyond swapping each worker's inbox. Workers send their matches'
+// snapshots straight out of the shared socket, a whole tick's worth at a time with sendmmsg.
+//
+// Any number of spectators can watch a match. Each tick is packed once for all of them, against
+// a keyframe made every KEYFRAME_INTERVAL ticks, and the same buffer goes to every one. A
+// spectator that hasn't acknowledged the latest keyframe is sent it again rather than anything
+// being queued for them, so one that falls behind just skips ahead. It only builds on Linux.
+
+const uint16_t DEFAULT_PORT = 7777;
+const int DEFAULT_REPORT_SECONDS = 10;
+const int INPUT_QUEUE = 64; // Inputs kept per player, indexed by sequence % INPUT_QUEUE
+const int MAX_QUEUED_INPUTS = 16; // Inputs a player can get ahead by before the oldest are skipped
+const int PLAYER_TIMEOUT_TICKS = SERVER_TICK_RATE * 5; // Without input before a player is dropped
+const int GAME_OVER_TICKS = SERVER_TICK_RATE * 5; // The final score is sent this long before the match closes
+const int RECEIVE_BATCH = 1024; // Packets read before checking the timer again
+const int SEND_BATCH = 1024; // Most packets handed to one sendmmsg call
+const int KEYFRAME_INTERVAL = SNAPSHOT_HISTORY / 2; // Ticks between spectator keyframes, within what they keep
+const int KEYFRAME_RESEND_TICKS = SERVER_TICK_RATE / 4; // Before an unacknowledged keyframe is sent again
+const int LATENCY_BUCKET_MICROSECONDS = 10;
+const int LATENCY_BUCKETS = 10000; // Up to 100 ms, anything slower goes in the last one
+
+#ifdef __linux__
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int) {
+  stopRequested = 1;
+}
+
+// Tick latencies, from when a tick was due until a worker finished it, in fixed width buckets
+class LatencyHistogram {
+public:
+  LatencyHistogram() : buckets(LATENCY_BUCKETS, 0) {}
+  void add(double microseconds) {
+    int bucket = std::min(LATENCY_BUCKETS - 1, std::max(0, int(microseconds / LATENCY_BUCKET_MICROSECONDS)));
+    ++buckets[bucket];
+    ++samples;
+    slowest = std::max(slowest, microseconds);
+  }
+  void merge(const LatencyHistogram& other) {
+    for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+      buckets[i] += other.buckets[i];
+    }
+    samples += other.samples;
+    slowest = std::max(slowest, other.slowest);
+  }
+  void clear() {
+    std::fill(buckets.begin(), buckets.end(), 0);
+    samples = 0;
+    slowest = 0;
+  }
+  long long count() const { return samples; }
+  double max() const { return slowest; }
+  // The upper edge of the bucket the fraction of samples falls in
+  double percentile(double fraction) const {
+    long long wanted = (long long)(fraction * samples + 0.5), seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+      seen += buckets[i];
+      if (seen >= wanted && seen > 0) {
+        return std::min(double((i + 1) * LATENCY_BUCKET_MICROSECONDS), slowest);
+      }
+    }
+    return slowest;
+  }
+
+private:
+  std::vector<long long> buckets;
+  long long samples = 0;
+  double slowest = 0;
+};
+
+struct ServerPlayer {
+  bool present = false;
+  NetAddress address;
+  uint8_t inputs[INPUT_QUEUE];
+  uint32_t inputSequences[INPUT_QUEUE];
+  uint32_t nextSequence = 0; // The next input to play
+  uint32_t newestSequence = 0; // One past the newest input that's arrived
+  uint8_t lastInput = 0; // Played again while the next one hasn't arrived
+  uint64_t lastHeardTick = 0;
+  bool hasSnapshotAck = false;
+  uint32_t snapshotAck = 0; // The newest snapshot the player has, what the next one is packed against
+};
+
+typedef std::shared_ptr<const std::vector<uint8_t>> SharedPacket;
+
+struct Spectator {
+  NetAddress address;
+  bool hasSnapshotAck = false;
+  uint32_t snapshotAck = 0;
+  uint64_t lastHeardTick = 0;
+  uint32_t keyframeSent = UINT32_MAX; // The keyframe last sent to catch them up, and when
+  uint64_t keyframeSentTick = 0;
+};
+
+struct ServerMatch {
+  uint32_t id = 0;
+  GameState game;
+  ServerPlayer players[2]; // Left then right
+  SnapshotHistory history; // What was sent, to pack later snapshots against
+  std::vector<Spectator> spectators;
+  MatchSnapshot keyframe; // What spectator snapshots are packed against
+  SharedPacket keyframePacket; // NULL until there are spectators
+  bool aiOnly = false; // Load test matches with both paddles played by AI, restarted when over
+  int gameOverTicks = 0;
+};
+
+enum CommandType {
+  COMMAND_CREATE,
+  COMMAND_ADD_PLAYER,
+  COMMAND_INPUT,
+  COMMAND_ADD_SPECTATOR,
+  COMMAND_SPECTATOR_ACK
+};
+
+// Something for a worker to do to one of its matches at the start of its next tick
+struct ServerCommand {
+  CommandType type;
+  uint32_t matchId;
+  NetAddress from;
+  int side; // COMMAND_ADD_PLAYER
+  uint64_t seed; // COMMAND_CREATE
+  bool aiOnly;
+  uint32_t snapshotAck; // COMMAND_INPUT and COMMAND_SPECTATOR_ACK, UINT32_MAX before the first snapshot
+  uint32_t firstSequence;
+  int count;
+  uint8_t inputs[MAX_SENT_INPUTS];
+};
+
+struct SendCounts {
+  long long snapshots = 0, bytes = 0; // Whole packets to players
+  long long spectatorPackets = 0, keyframes = 0; // Keyframes sent to catch spectators up
+  long long dropped = 0; // Packets the socket had no room for
+};
+
+// A tick's packets, sent together with sendmmsg. Packets shared by many spectators are only
+// referenced, everything else is copied in.
+class SendBatch {
+public:
+  explicit SendBatch(int socket) : socket(socket) {}
+  void add(const NetAddress& to, const uint8_t* data, int size) {
+    entries.push_back({to, copies.size(), size, NULL});
+    copies.insert(copies.end(), data, data + size);
+  }
+  void addShared(const NetAddress& to, const SharedPacket& packet) {
+    entries.push_back({to, 0, int(packet->size()), packet});
+  }
+  // Sends everything queued, whatever the socket has no room for is dropped and counted
+  void flush(SendCounts* counts) {
+    for (size_t first = 0; first < entries.size(); first += SEND_BATCH) {
+      int count = int(std::min(entries.size() - first, size_t(SEND_BATCH)));
+      for (int i = 0; i < count; ++i) {
+        const Entry& entry = entries[first + i];
+        sockaddr_in& address = addresses[i];
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(entry.to.ip);
+        address.sin_port = htons(entry.to.port);
+        const uint8_t* data = entry.shared ? entry.shared->data() : copies.data() + entry.offset;
+        vectors[i].iov_base = (void*)data;
+        vectors[i].iov_len = entry.size;
+        memset(&messages[i], 0, sizeof(messages[i]));
+        messages[i].msg_hdr.msg_name = &address;
+        messages[i].msg_hdr.msg_namelen = sizeof(address);
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+      }
+      int sent = 0;
+      while (sent < count) {
+        int result = sendmmsg(socket, messages + sent, count - sent, 0);
+        if (result <= 0) {
+          // A full socket buffer drops the rest of the batch, a bad address just skips that packet
+          if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+          ++counts->dropped;
+          ++sent;
+        } else {
+          sent += result;
+        }
+      }
+      counts->dropped += count - sent;
+    }
+    entries.clear();
+    copies.clear();
+  }
+
+private:
+  struct Entry {
+    NetAddress to;
+    size_t offset; // Into copies when not shared
+    int size;
+    SharedPacket shared;
+  };
+
+  int socket;
+  std::vector<Entry> entries;
+  std::vector<uint8_t> copies;
+  mmsghdr messages[SEND_BATCH];
+  iovec vectors[SEND_BATCH];
+  sockaddr_in addresses[SEND_BATCH];
+};
+
+// One worker's matches and what's waiting for it
+struct Shard {
+  std::mutex inboxMutex;
+  std::vector<ServerCommand> inbox;
+  std::vector<uint32_t> closed; // Matches that ended, for the main thread to forget, under inboxMutex
+
+  std::vector<ServerMatch> matches; // Only touched by the worker
+  std::unordered_map<uint32_t, size_t> matchIndex;
+
+  std::mutex statsMutex;
+  LatencyHistogram latencies;
+  long long overruns = 0; // Ticks finished after the next one was due
+  SendCounts sent;
+  std::atomic<int> matchCount {0};
+  std::atomic<int> spectatorCount {0};
+};
+
+// When ticks are due, shared by the main thread and the workers
+struct TickClock {
+  std::mutex mutex;
+  std::condition_variable signal;
+  uint64_t scheduled = 0; // Ticks that have come due
+  bool stopping = false;
+  std::chrono::steady_clock::time_point start;
+};
+
+static void queueInput(ServerPlayer* player, const ServerCommand& command, uint64_t tick) {
+  player->lastHeardTick = tick;
+  if (command.snapshotAck != UINT32_MAX && (!player->hasSnapshotAck || command.snapshotAck > player->snapshotAck)) {
+    player->hasSnapshotAck = true;
+    player->snapshotAck = command.snapshotAck;
+  }
+  for (int i = 0; i < command.count; ++i) {
+    uint32_t sequence = command.firstSequence + i;
+    if (sequence < player->nextSequence) {
+      continue; // Already played
+    }
+    player->inputs[sequence % INPUT_QUEUE] = command.inputs[i];
+    player->inputSequences[sequence % INPUT_QUEUE] = sequence;
+    player->newestSequence = std::max(player->newestSequence, sequence + 1);
+  }
+  // A player whose clock runs fast gets ahead, skipping the oldest keeps their delay bounded
+  if (player->newestSequence - player->nextSequence > uint32_t(MAX_QUEUED_INPUTS)) {
+    player->nextSequence = player->newestSequence - MAX_QUEUED_INPUTS;
+  }
+}
+
+// The player's input for the next step, their last one again if it hasn't arrived
+static uint8_t takeInput(ServerPlayer* player) {
+  if (!player->present) {
+    return 0;
+  }
+  int slot = player->nextSequence % INPUT_QUEUE;
+  if (player->nextSequence < player->newestSequence && player->inputSequences[slot] == player->nextSequence) {
+    player->lastInput = player->inputs[slot] & INPUT_LEFT_MASK;
+    ++player->nextSequence;
+  }
+  return player->lastInput;
+}
+
+static void answerSpectator(SendBatch* batch, const NetAddress& to, uint32_t matchId, bool found) {
+  uint8_t answer[8] = {SERVER_SPECTATING, SERVER_PROTOCOL_VERSION, SIMULATION_FLAGS};
+  writeU32(answer + 3, matchId);
+  answer[7] = found;
+  batch->add(to, answer, sizeof(answer));
+}
+
+static Spectator* findSpectator(ServerMatch* match, const NetAddress& address) {
+  for (Spectator& spectator : match->spectators) {
+    if (spectator.address == address) {
+      return &spectator;
+    }
+  }
+  return NULL;
+}
+
+static void applyCommand(Shard* shard, const ServerCommand& command, uint64_t tick, SendBatch* batch) {
+  if (command.type == COMMAND_CREATE) {
+    shard->matchIndex[command.matchId] = shard->matches.size();
+    shard->matches.emplace_back();
+    ServerMatch& match = shard->matches.back();
+    match.id = command.matchId;
+    match.aiOnly = command.aiOnly;
+    initGame(&match.game, command.seed);
+    match.game.player1Ai = command.aiOnly;
+    match.game.player2Ai = command.aiOnly;
+    shard->matchCount = int(shard->matches.size());
+    return;
+  }
+  auto found = shard->matchIndex.find(command.matchId);
+  if (found == shard->matchIndex.end()) {
+    if (command.type == COMMAND_ADD_SPECTATOR) {
+      answerSpectator(batch, command.from, command.matchId, false);
+    }
+    return; // Closed since, or never was
+  }
+  ServerMatch& match = shard->matches[found->second];
+  if (command.type == COMMAND_ADD_SPECTATOR || command.type == COMMAND_SPECTATOR_ACK) {
+    Spectator* spectator = findSpectator(&match, command.from);
+    if (!spectator && command.type == COMMAND_ADD_SPECTATOR) {
+      match.spectators.emplace_back();
+      spectator = &match.spectators.back();
+      spectator->address = command.from;
+    }
+    if (!spectator) {
+      return; // Already timed out
+    }
+    spectator->lastHeardTick = tick;
+    if (command.type == COMMAND_ADD_SPECTATOR) {
+      answerSpectator(batch, command.from, command.matchId, true); // Answered every time in case one's lost
+    } else if (command.snapshotAck != UINT32_MAX && (!spectator->hasSnapshotAck || command.snapshotAck > spectator->snapshotAck)) {
+      spectator->hasSnapshotAck = true;
+      spectator->snapshotAck = command.snapshotAck;
+    }
+  } else if (command.type == COMMAND_ADD_PLAYER) {
+    ServerPlayer& player = match.players[command.side];
+    player = ServerPlayer();
+    player.present = true;
+    player.address = command.from;
+    player.lastHeardTick = tick;
+    memset(player.inputSequences, 0xFF, sizeof(player.inputSequences));
+  } else {
+    for (ServerPlayer& player : match.players) {
+      if (player.present && player.address == command.from) {
+        queueInput(&player, command, tick);
+      }
+    }
+  }
+}
+
+static void closeMatch(Shard* shard, size_t index) {
+  {
+    std::lock_guard<std::mutex> lock(shard->inboxMutex);
+    shard->closed.push_back(shard->matches[index].id);
+  }
+  shard->matchIndex.erase(shard->matches[index].id);
+  if (index + 1 < shard->matches.size()) {
+    shard->matches[index] = std::move(shard->matches.back());
+    shard->matchIndex[shard->matches[index].id] = index;
+  }
+  shard->matches.pop_back();
+  shard->matchCount = int(shard->matches.size());
+}
+
+// Sends each player the snapshot packed against the newest one they said they have, or whole
+// if that's too old or they haven't got any yet
+static void sendSnapshot(SendBatch* batch, const ServerMatch& match, const MatchSnapshot& snapshot, SendCounts* sent) {
+  uint8_t packet[9 + MAX_SNAPSHOT_BYTES];
+  packet[0] = SERVER_STATE;
+  writeU32(packet + 1, match.id);
+  for (const ServerPlayer& player : match.players) {
+    if (!player.present) {
+      continue;
+    }
+    writeU32(packet + 5, player.nextSequence); // Lets the player know which of their inputs were played
+    const MatchSnapshot* baseline = player.hasSnapshotAck ? match.history.find(player.snapshotAck) : NULL;
+    int size = 9 + encodeSnapshot(&snapshot, baseline, packet + 9, MAX_SNAPSHOT_BYTES);
+    batch->add(player.address, packet, size);
+    ++sent->snapshots;
+    sent->bytes += size;
+  }
+}
+
+// Packs the snapshot once for every spectator, and the keyframe as well for any that haven't
+// acknowledged it, dropping spectators that have gone quiet
+static void sendToSpectators(SendBatch* batch, ServerMatch* match, const MatchSnapshot& snapshot, uint64_t tick,
+    SendCounts* sent) {
+  auto quiet = [&](const Spectator& spectator) { return tick - spectator.lastHeardTick > uint64_t(PLAYER_TIMEOUT_TICKS); };
+  match->spectators.erase(std::remove_if(match->spectators.begin(), match->spectators.end(), quiet),
+    match->spectators.end());
+  if (match->spectators.empty()) {
+    match->keyframePacket = NULL;
+    return;
+  }
+
+  uint8_t packet[9 + MAX_SNAPSHOT_BYTES] = {SERVER_STATE};
+  writeU32(packet + 1, match->id);
+  writeU32(packet + 5, 0); // Spectators have no inputs
+  if (!match->keyframePacket || snapshot.tick - match->keyframe.tick >= uint32_t(KEYFRAME_INTERVAL * STEPS_PER_SERVER_TICK)) {
+    match->keyframe = snapshot;
+    match->keyframe.soundEvents = 0; // Sent again to catch spectators up, so sounds go with the snapshots instead
+    int size = 9 + encodeSnapshot(&match->keyframe, NULL, packet + 9, MAX_SNAPSHOT_BYTES);
+    match->keyframePacket = std::make_shared<const std::vector<uint8_t>>(packet, packet + size);
+  }
+  int size = 9 + encodeSnapshot(&snapshot, &match->keyframe, packet + 9, MAX_SNAPSHOT_BYTES);
+  SharedPacket frame = std::make_shared<const std::vector<uint8_t>>(packet, packet + size);
+
+  for (Spectator& spectator : match->spectators) {
+    bool hasKeyframe = spectator.hasSnapshotAck && spectator.snapshotAck >= match->keyframe.tick;
+    bool keyframeInFlight = spectator.keyframeSent == match->keyframe.tick &&
+      tick - spectator.keyframeSentTick < uint64_t(KEYFRAME_RESEND_TICKS);
+    if (!hasKeyframe && !keyframeInFlight) {
+      batch->addShared(spectator.address, match->keyframePacket);
+      spectator.keyframeSent = match->keyframe.tick;
+      spectator.keyframeSentTick = tick;
+      ++sent->keyframes;
+    }
+    batch->addShared(spectator.address, frame);
+    ++sent->spectatorPackets;
+  }
+}
+
+// Plays one tick of the match, returns false once it should close
+static bool tickMatch(SendBatch* batch, ServerMatch* match, uint64_t tick, SendCounts* sent) {
+  GameState& game = match->game;
+  bool waiting = !match->aiOnly && !(match->players[0].present && match->players[1].present);
+  if (!match->aiOnly) {
+    for (const ServerPlayer& player : match->players) {
+      if (player.present && tick - player.lastHeardTick > uint64_t(PLAYER_TIMEOUT_TICKS)) {
+        return false;
+      }
+    }
+  }
+  // Nothing moves until both players are here, the first one still sees the court
+  for (int step = 0; step < STEPS_PER_SERVER_TICK && !waiting; ++step) {
+    uint8_t input = takeInput(&match->players[0]) | takeInput(&match->players[1]) << 2;
+    stepGame(&game, input, SIMULATION_STEP);
+  }
+  if (game.gameOver) {
+    if (match->aiOnly) {
+      restartGame(&game);
+    } else if (++match->gameOverTicks > GAME_OVER_TICKS) {
+      return false;
+    }
+  }
+
+  MatchSnapshot snapshot;
+  captureSnapshot(&game, &snapshot);
+  game.soundEvents = 0;
+  game.ballTeleported = false;
+  match->history.add(snapshot);
+  sendSnapshot(batch, *match, snapshot, sent);
+  if (!match->spectators.empty()) {
+    sendToSpectators(batch, match, snapshot, tick, sent);
+  }
+  return true;
+}
+
+static void runWorker(Shard* shard, TickClock* clock, UdpSocket* socket) {
+  const std::chrono::duration<double, std::milli> period(1000.0 / SERVER_TICK_RATE);
+  std::vector<ServerCommand> commands;
+  SendCounts sent; // Added to the shard's under the lock once the tick's done
+  std::unique_ptr<SendBatch> batch(new SendBatch(int(socket->nativeHandle())));
+  uint64_t done = 0;
+  while (true) {
+    uint64_t due;
+    {
+      std::unique_lock<std::mutex> lock(clock->mutex);
+      clock->signal.wait(lock, [&]() { return clock->stopping || clock->scheduled > done; });
+      if (clock->stopping) {
+        return;
+      }
+      due = clock->scheduled;
+    }
+
+    // Ticks missed while a slow one ran are caught up on straight away
+    while (done < due) {
+      ++done;
+      commands.clear();
+      {
+        std::lock_guard<std::mutex> lock(shard->inboxMutex);
+        commands.swap(shard->inbox);
+      }
+      for (const ServerCommand& command : commands) {
+        applyCommand(shard, command, done, batch.get());
+      }
+      int spectators = 0;
+      for (size_t i = 0; i < shard->matches.size();) {
+        if (tickMatch(batch.get(), &shard->matches[i], done, &sent)) {
+          spectators += int(shard->matches[i].spectators.size());
+          ++i;
+        } else {
+          closeMatch(shard, i);
+        }
+      }
+      batch->flush(&sent);
+      shard->spectatorCount = spectators;
+
+      auto dueTime = clock->start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(period * double(done));
+      double latency = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - dueTime).count();
+      std::lock_guard<std::mutex> lock(shard->statsMutex);
+      shard->latencies.add(latency);
+      if (latency > std::chrono::duration<double, std::micro>(period).count()) ++shard->overruns;
+      shard->sent.snapshots += sent.snapshots;
+      shard->sent.bytes += sent.bytes;
+      shard->sent.spectatorPackets += sent.spectatorPackets;
+      shard->sent.keyframes += sent.keyframes;
+      shard->sent.dropped += sent.dropped;
+      sent = SendCounts();
+    }
+  }
+}
+
+// Who's playing where, only used by the main thread
+struct Lobby {
+  std::unordered_map<uint64_t, std::pair<uint32_t, int>> players; // Address to match and side
+  std::unordered_map<uint32_t, std::vector<uint64_t>> matchPlayers;
+  uint32_t waitingMatch = UINT32_MAX; // Has a left player and needs a right one
+  uint32_t nextMatchId = 0;
+};
+
+static uint64_t addressKey(const NetAddress& address) {
+  return uint64_t(address.ip) << 16 | address.port;
+}
+
+static void pushCommand(std::vector<Shard>* shards, const ServerCommand& command) {
+  Shard& shard = (*shards)[command.matchId % shards->size()];
+  std::lock_guard<std::mutex> lock(shard.inboxMutex);
+  shard.inbox.push_back(command);
+}
+
+static void handleJoin(UdpSocket* socket, std::vector<Shard>* shards, Lobby* lobby, uint64_t seed,
+    const uint8_t* packet, int size, const NetAddress& from) {
+  if (size < 3 || packet[1] != SERVER_PROTOCOL_VERSION || packet[2] != SIMULATION_FLAGS) {
+    return;
+  }
+  uint64_t key = addressKey(from);
+  auto found = lobby->players.find(key);
+  if (found == lobby->players.end()) {
+    ServerCommand command = {};
+    command.from = from;
+    if (lobby->waitingMatch != UINT32_MAX) {
+      command.matchId = lobby->waitingMatch;
+      command.side = 1;
+      lobby->waitingMatch = UINT32_MAX;
+    } else {
+      command.type = COMMAND_CREATE;
+      command.matchId = lobby->nextMatchId++;
+      command.seed = seed + command.matchId;
+      pushCommand(shards, command);
+      command.side = 0;
+      lobby->waitingMatch = command.matchId;
+    }
+    command.type = COMMAND_ADD_PLAYER;
+    pushCommand(shards, command);
+    found = lobby->players.emplace(key, std::make_pair(command.matchId, command.side)).first;
+    lobby->matchPlayers[command.matchId].push_back(key);
+  }
+  // Joins are answered every time so a lost answer is made up for by the next join
+  uint8_t answer[8] = {SERVER_JOINED, SERVER_PROTOCOL_VERSION, SIMULATION_FLAGS};
+  writeU32(answer + 3, found->second.first);
+  answer[7] = uint8_t(found->second.second);
+  socket->send(from, answer, sizeof(answer));
+}
+
+static void handleInput(std::vector<Shard>* shards, const uint8_t* packet, int size, const NetAddress& from) {
+  if (size < 14 || packet[13] > MAX_SENT_INPUTS || size < 14 + packet[13]) {
+    return;
+  }
+  ServerCommand command = {};
+  command.type = COMMAND_INPUT;
+  command.matchId = readU32(packet + 1);
+  command.from = from;
+  command.snapshotAck = readU32(packet + 5);
+  command.firstSequence = readU32(packet + 9);
+  command.count = packet[13];
+  memcpy(command.inputs, packet + 14, command.count);
+  pushCommand(shards, command);
+}
+
+static void handleSpectator(std::vector<Shard>* shards, const uint8_t* packet, int size, const NetAddress& from) {
+  ServerCommand command = {};
+  command.from = from;
+  if (packet[0] == SERVER_SPECTATE) {
+    if (size < 7 || packet[1] != SERVER_PROTOCOL_VERSION || packet[2] != SIMULATION_FLAGS) {
+      return;
+    }
+    command.type = COMMAND_ADD_SPECTATOR;
+    command.matchId = readU32(packet + 3);
+  } else {
+    if (size < 9) {
+      return;
+    }
+    command.type = COMMAND_SPECTATOR_ACK;
+    command.matchId = readU32(packet + 1);
+    command.snapshotAck = readU32(packet + 5);
+  }
+  pushCommand(shards, command);
+}
+
+static void forgetClosedMatches(std::vector<Shard>* shards, Lobby* lobby) {
+  std::vector<uint32_t> closed;
+  for (Shard& shard : *shards) {
+    {
+      std::lock_guard<std::mutex> lock(shard.inboxMutex);
+      closed.swap(shard.closed);
+    }
+    for (uint32_t id : closed) {
+      for (uint64_t key : lobby->matchPlayers[id]) {
+        lobby->players.erase(key);
+      }
+      lobby->matchPlayers.erase(id);
+      if (lobby->waitingMatch == id) lobby->waitingMatch = UINT32_MAX;
+    }
+    closed.clear();
+  }
+}
+
+// Prints one line of tick latency percentiles in microseconds for the ticks since the last one
+static void reportLatencies(std::vector<Shard>* shards, double seconds, LatencyHistogram* total, long long* totalOverruns) {
+  LatencyHistogram interval;
+  long long overruns = 0, snapshots = 0, snapshotBytes = 0; // Player snapshots
+  SendCounts sent;
+  int matches = 0, spectators = 0;
+  for (Shard& shard : *shards) {
+    std::lock_guard<std::mutex> lock(shard.statsMutex);
+    interval.merge(shard.latencies);
+    shard.latencies.clear();
+    overruns += shard.overruns;
+    shard.overruns = 0;
+    snapshots += shard.sent.snapshots;
+    snapshotBytes += shard.sent.bytes;
+    sent.spectatorPackets += shard.sent.spectatorPackets;
+    sent.keyframes += shard.sent.keyframes;
+    sent.dropped += shard.sent.dropped;
+    shard.sent = SendCounts();
+    matches += shard.matchCount;
+    spectators += shard.spectatorCount;
+  }
+  total->merge(interval);
+  *totalOverruns += overruns;
+  std::cout << std::fixed << std::setprecision(0) << seconds << "\t" << matches << "\t" << interval.count() << "\t"
+    << interval.percentile(0.5) << "\t" << interval.percentile(0.9) << "\t" << interval.percentile(0.99) << "\t"
+    << interval.percentile(0.999) << "\t" << interval.max() << "\t" << overruns << "\t" << std::setprecision(1)
+    << (snapshots > 0 ? double(snapshotBytes) / snapshots : 0.0) << "\t" << std::setprecision(0) << spectators << "\t"
+    << sent.spectatorPackets << "\t" << sent.keyframes << "\t" << sent.dropped << std::endl;
+}
+
+void printUsage() {
+  std::cout << "Usage: pong-server [--port <port>] [--workers <count>] [--seed <seed>] [--ai-matches <count>]\n"
+    << "                   [--duration <seconds>] [--report <seconds>]\n"
+    << "  --port        UDP port to serve on, defaults to " << DEFAULT_PORT << "\n"
+    << "  --workers     Simulation threads, defaults to the number of cores\n"
+    << "  --seed        Seed of the first match, each match after it adds one\n"
+    << "  --ai-matches  Start this many AI against AI matches that restart when over, to load test\n"
+    << "  --duration    Stop after this many seconds instead of waiting for Ctrl+C\n"
+    << "  --report      Seconds between tick latency reports, defaults to " << DEFAULT_REPORT_SECONDS << "\n"
+    << "Players connect with pong --server <host>:<port>, two at a time are paired into a match.\n"
+    << "Spectators watch one with pong --server <host>:<port> --spectate <match id>.\n";
+}
+
+int main(int argc, char *argv[]) {
+  int port = DEFAULT_PORT;
+  int workerCount = std::thread::hardware_concurrency();
+  uint64_t seed = time(0);
+  int aiMatches = 0;
+  double duration = 0;
+  int reportSeconds = DEFAULT_REPORT_SECONDS;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    bool valid = i + 1 < argc;
+    if (valid && arg == "--port") {
+      port = atoi(argv[++i]);
+      valid = port > 0 && port <= 65535;
+    } else if (valid && arg == "--workers") {
+      workerCount = atoi(argv[++i]);
+      valid = workerCount > 0;
+    } else if (valid && arg == "--seed") {
+      seed = strtoull(argv[++i], NULL, 10);
+    } else if (valid && arg == "--ai-matches") {
+      aiMatches = atoi(argv[++i]);
+      valid = aiMatches >= 0;
+    } else if (valid && arg == "--duration") {
+      duration = atof(argv[++i]);
+      valid = duration > 0;
+    } else if (valid && arg == "--report") {
+      reportSeconds = atoi(argv[++i]);
+      valid = reportSeconds > 0;
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      printUsage();
+      return 1;
+    }
+  }
+  if (workerCount <= 0) workerCount = 1;
+
+  UdpSocket socket;
+  if (!socket.open(port)) {
+    std::cout << "Opening UDP Port " << port << " Failed\n";
+    return 1;
+  }
+  int epoll = epoll_create1(0);
+  int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+  if (epoll < 0 || timer < 0) {
+    std::cout << "Creating Server Event Loop Failed\n";
+    return 1;
+  }
+  epoll_event socketEvent = {}, timerEvent = {};
+  socketEvent.events = EPOLLIN;
+  socketEvent.data.fd = int(socket.nativeHandle());
+  timerEvent.events = EPOLLIN;
+  timerEvent.data.fd = timer;
+  if (epoll_ctl(epoll, EPOLL_CTL_ADD, socketEvent.data.fd, &socketEvent) != 0 ||
+      epoll_ctl(epoll, EPOLL_CTL_ADD, timer, &timerEvent) != 0) {
+    std::cout << "Creating Server Event Loop Failed\n";
+    return 1;
+  }
+
+  std::vector<Shard> shards(workerCount);
+  Lobby lobby;
+  for (int i = 0; i < aiMatches; ++i) {
+    ServerCommand command = {};
+    command.type = COMMAND_CREATE;
+    command.matchId = lobby.nextMatchId++;
+    command.seed = seed + command.matchId;
+    command.aiOnly = true;
+    pushCommand(&shards, command);
+  }
+
+  TickClock clock;
+  itimerspec interval = {};
+  interval.it_interval.tv_nsec = 1000000000L / SERVER_TICK_RATE;
+  interval.it_value = interval.it_interval;
+  clock.start = std::chrono::steady_clock::now();
+  timerfd_settime(timer, 0, &interval, NULL);
+  std::vector<std::thread> workers;
+  for (Shard& shard : shards) {
+    workers.emplace_back(runWorker, &shard, &clock, &socket);
+  }
+  signal(SIGINT, requestStop);
+  signal(SIGTERM, requestStop);
+
+  std::cout << "Serving on port " << port << " with " << workerCount << " workers at " << SERVER_TICK_RATE
+    << " ticks a second\n";
+  std::cout << "seconds\tmatches\tticks\tp50 us\tp90 us\tp99 us\tp99.9 us\tmax us\toverruns\tbytes/snapshot\tspectators\tspectator packets\tkeyframes\tdropped" << std::endl;
+  LatencyHistogram total;
+  long long totalOverruns = 0;
+  uint64_t ticks = 0, reportedTicks = 0;
+  uint8_t packet[MAX_SERVER_PACKET];
+  NetAddress from;
+  epoll_event events[2];
+  while (!stopRequested && (duration <= 0 || ticks < duration * SERVER_TICK_RATE)) {
+    int ready = epoll_wait(epoll, events, 2, 100);
+    for (int i = 0; i < ready; ++i) {
+      if (events[i].data.fd == timer) {
+        uint64_t expirations = 0;
+        if (read(timer, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+          continue;
+        }
+        ticks += expirations;
+        {
+          std::lock_guard<std::mutex> lock(clock.mutex);
+          clock.scheduled = ticks;
+        }
+        clock.signal.notify_all();
+        forgetClosedMatches(&shards, &lobby);
+        if (ticks - reportedTicks >= uint64_t(reportSeconds) * SERVER_TICK_RATE) {
+          reportedTicks = ticks;
+          reportLatencies(&shards, double(ticks) / SERVER_TICK_RATE, &total, &totalOverruns);
+        }
+        continue;
+      }
+      int size;
+      for (int received = 0; received < RECEIVE_BATCH &&
+          (size = socket.receive(packet, sizeof(packet), &from)) >= 0; ++received) {
+        if (size >= 1 && packet[0] == SERVER_JOIN) {
+          handleJoin(&socket, &shards, &lobby, seed, packet, size, from);
+        } else if (size >= 1 && packet[0] == SERVER_INPUT) {
+          handleInput(&shards, packet, size, from);
+        } else if (size >= 1 && (packet[0] == SERVER_SPECTATE || packet[0] == SERVER_SPECTATOR_ACK)) {
+          handleSpectator(&shards, packet, size, from);
+        }
+      }
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(clock.mutex);
+    clock.stopping = true;
+  }
+  clock.signal.notify_all();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  reportLatencies(&shards, double(ticks) / SERVER_TICK_RATE, &total, &totalOverruns);
+  std::cout << std::setprecision(0) << "Whole run: " << total.count() << " worker ticks, p50 " << total.percentile(0.5)
+    << " us, p90 " << total.percentile(0.9) << " us, p99 " << total.percentile(0.99) << " us, p99.9 "
+    << total.percentile(0.999) << " us, max " << total.max() << " us, " << totalOverruns << " overruns\n";
+  close(timer);
+  close(epoll);
+  return 0;
+}
+
+#else
+
+int main() {
+  std::cout << "Starting Server Failed (Only Possible On Linux)\n";
+  return 1;
+}
+
+#endif
@@ -0,0 +1,159 @@
+#include "server_client.h"
+#include <algorithm>
+#include <math.h>
+
+const double JOIN_RESEND = 250.0; // Milliseconds between joins until the server answers
+
+ServerClient::ServerClient(UdpSocket* socket, const NetAddress& server)
+    : socket(socket), server(server), lastHeard(-1) {
+  initGame(&game, 0);
+  game.player2Ai = false;
+  view = game;
+}
+
+ServerClient::ServerClient(UdpSocket* socket, const NetAddress& server, uint32_t spectateMatch)
+    : ServerClient(socket, server) {
+  spectating = true;
+  matchId = spectateMatch;
+}
+
+bool ServerClient::lost(double now) const {
+  return lastHeard >= 0 && now - lastHeard > SERVER_TIMEOUT;
+}
+
+void ServerClient::poll(double now) {
+  if (lastHeard < 0) lastHeard = now; // Counted from the first poll so a server that never answers times out
+  uint8_t packet[MAX_SERVER_PACKET];
+  NetAddress from;
+  int size;
+  while ((size = socket->receive(packet, sizeof(packet), &from)) >= 0) {
+    if (!(from == server) || size < 1) {
+      continue;
+    }
+    if (packet[0] == SERVER_JOINED && size >= 8 && packet[1] == SERVER_PROTOCOL_VERSION &&
+        packet[2] == SIMULATION_FLAGS && !hasJoined) {
+      matchId = readU32(packet + 3);
+      side = packet[7];
+      hasJoined = true;
+      lastHeard = now;
+    } else if (packet[0] == SERVER_SPECTATING && size >= 8 && packet[1] == SERVER_PROTOCOL_VERSION &&
+        packet[2] == SIMULATION_FLAGS && spectating && !hasJoined && readU32(packet + 3) == matchId) {
+      hasJoined = packet[7] != 0;
+      wasRefused = packet[7] == 0;
+      lastHeard = now;
+    } else if (packet[0] == SERVER_STATE && hasJoined) {
+      receiveState(packet, size, now);
+    }
+  }
+  if (!hasJoined && !wasRefused && now - lastJoinSent >= JOIN_RESEND) {
+    uint8_t join[7] = {spectating ? SERVER_SPECTATE : SERVER_JOIN, SERVER_PROTOCOL_VERSION, SIMULATION_FLAGS};
+    writeU32(join + 3, matchId);
+    socket->send(server, join, spectating ? 7 : 3);
+    lastJoinSent = now;
+  }
+  // Spectators send nothing else, so they say which snapshots they have here. Anything packed
+  // against a keyframe they haven't acknowledged comes with the keyframe again.
+  if (hasJoined && spectating && now - lastAckSent >= SPECTATOR_ACK_INTERVAL) {
+    uint8_t ack[9] = {SERVER_SPECTATOR_ACK};
+    writeU32(ack + 1, matchId);
+    writeU32(ack + 5, history.empty() ? UINT32_MAX : history.newestTick());
+    socket->send(server, ack, sizeof(ack));
+    lastAckSent = now;
+  }
+}
+
+void ServerClient::receiveState(const uint8_t* packet, int size, double now) {
+  MatchSnapshot snapshot;
+  if (size < 10 || readU32(packet + 1) != matchId || !decodeSnapshot(packet + 9, size - 9, &history, &snapshot)) {
+    return;
+  }
+  history.add(snapshot);
+  lastHeard = now;
+  acknowledged = std::max(acknowledged, std::min(readU32(packet + 5), nextSequence));
+  if (snapshot.tick < history.newestTick()) {
+    game.soundEvents |= snapshot.soundEvents; // Late, but its sounds haven't been heard
+    return;
+  }
+  applySnapshot(&snapshot, &game);
+  reconcile();
+}
+
+bool ServerClient::predicting() const {
+  // Nothing moves while the server waits for the other player, and paddles stay put once it's over
+  return hasJoined && !spectating && game.tick > 0 && !game.gameOver;
+}
+
+Paddle* ServerClient::localPaddle(GameState* state) const {
+  return side == 0 ? &state->paddleLeft : &state->paddleRight;
+}
+
+void ServerClient::reconcile() {
+  if (spectating) {
+    view = game;
+    return;
+  }
+  Paddle replayed = *localPaddle(&game);
+  // Past INPUT_HISTORY the server has skipped some, so its paddle is the best guess there is
+  if (predicting() && nextSequence - acknowledged <= uint32_t(INPUT_HISTORY)) {
+    for (uint32_t sequence = acknowledged; sequence < nextSequence; ++sequence) {
+      stepHeldPaddle(&replayed, inputs[sequence % INPUT_HISTORY], SIMULATION_STEP);
+    }
+  }
+  // Snapshots are rounded to a sixteenth of a pixel, anything under that is the same place
+  Real error = predicted.rect.y + correction - replayed.rect.y;
+  if (fabs(error) > 0.125f) {
+    ++predictionStats.corrections;
+    predictionStats.largestCorrection = std::max(predictionStats.largestCorrection, float(fabs(error)));
+  }
+  correction = fabs(error) > CORRECTION_SNAP ? Real(0.0f) : error;
+  predicted = replayed;
+  updateView();
+}
+
+void ServerClient::updateView() {
+  view = game;
+  Paddle* shown = localPaddle(&view);
+  *shown = predicted;
+  shown->rect.y += correction;
+  if (shown->rect.y > WINDOW_HEIGHT - PADDLE_HEIGHT) {
+    shown->rect.y = WINDOW_HEIGHT - PADDLE_HEIGHT;
+  } else if (shown->rect.y < 0) {
+    shown->rect.y = 0;
+  }
+}
+
+void ServerClient::sendInput(uint8_t paddleInput) {
+  if (!hasJoined || spectating) {
+    return;
+  }
+  inputs[nextSequence % INPUT_HISTORY] = paddleInput;
+  ++nextSequence;
+  uint32_t first = std::max(acknowledged, nextSequence - std::min<uint32_t>(nextSequence, MAX_SENT_INPUTS));
+  uint8_t packet[14 + MAX_SENT_INPUTS];
+  packet[0] = SERVER_INPUT;
+  writeU32(packet + 1, matchId);
+  // The newest snapshot here, for the server to pack the next ones against
+  writeU32(packet + 5, history.empty() ? UINT32_MAX : history.newestTick());
+  writeU32(packet + 9, first);
+  packet[13] = uint8_t(nextSequence - first);
+  for (uint32_t sequence = first; sequence < nextSequence; ++sequence) {
+    packet[14 + sequence - first] = inputs[sequence % INPUT_HISTORY];
+  }
+  socket->send(server, packet, 14 + packet[13]);
+
+  if (predicting()) {
+    stepHeldPaddle(&predicted, paddleInput, SIMULATION_STEP);
+  }
+  correction -= correction * (SIMULATION_STEP / CORRECTION_TIME);
+  if (fabs(correction) < 0.0625f) {
+    correction = 0.0f;
+  }
+  updateView();
+}
+
+int ServerClient::takeSoundEvents() {
+  int events = game.soundEvents;
+  game.soundEvents = 0;
+  view.soundEvents = 0;
+  return events;
+}
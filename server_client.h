@@ -0,0 +1,84 @@
+#ifndef SERVER_CLIENT_H
+#define SERVER_CLIENT_H
+
+#include "game.h"
+#include "net.h"
+#include "server_protocol.h"
+
+// Plays or watches a match on pong-server. The server runs the match, this sends the local
+// paddle's input for every step and shows whatever the latest snapshot says, except for the
+// local paddle which moves as soon as its input is sent. Each snapshot puts it back where the
+// server had it and plays the inputs the server hasn't got to yet on top, and when that ends up
+// somewhere else the shown paddle slides over instead of jumping.
+
+const double SERVER_TIMEOUT = 5000.0; // Milliseconds without a snapshot before giving up
+const double SPECTATOR_ACK_INTERVAL = 100.0; // Milliseconds between spectators saying what they have
+const float CORRECTION_TIME = 50.0f; // Roughly how many milliseconds the local paddle takes to slide into place
+const Real CORRECTION_SNAP = PADDLE_HEIGHT; // Pixels off past which it jumps there instead
+
+struct PredictionStats {
+  long long corrections = 0; // Snapshots that put the local paddle somewhere other than predicted
+  float largestCorrection = 0.0f; // In pixels
+};
+
+class ServerClient {
+public:
+  // Asks to be paired up with another player
+  ServerClient(UdpSocket* socket, const NetAddress& server);
+  // Watches the match without playing
+  ServerClient(UdpSocket* socket, const NetAddress& server, uint32_t spectateMatch);
+  bool joined() const { return hasJoined; }
+  // The server said there's no such match to watch
+  bool refused() const { return wasRefused; }
+  bool spectator() const { return spectating; }
+  uint32_t match() const { return matchId; }
+  bool leftSide() const { return side == 0; }
+  // The match as of the latest snapshot, with the local paddle wherever the inputs sent so far take it
+  const GameState& state() const { return view; }
+  const PredictionStats& stats() const { return predictionStats; }
+  // Whether the server's gone quiet for too long, now is in milliseconds from any fixed point
+  bool lost(double now) const;
+
+  // Reads everything that's arrived, asking to join again until the server answers
+  void poll(double now);
+  // Sends the local paddle's input for the next step, INPUT_LEFT_UP or INPUT_LEFT_DOWN whichever
+  // side it's on, along with the ones the server hasn't played yet
+  void sendInput(uint8_t paddleInput);
+  // Sounds raised by the snapshots since the last call
+  int takeSoundEvents();
+
+private:
+  void receiveState(const uint8_t* packet, int size, double now);
+  // Whether the server is playing the match, so inputs sent now will move the paddle
+  bool predicting() const;
+  Paddle* localPaddle(GameState* state) const;
+  // Starts again from the paddle in the latest snapshot and plays every input it doesn't include
+  void reconcile();
+  void updateView();
+
+  static const int INPUT_HISTORY = 64;
+
+  UdpSocket* socket;
+  NetAddress server;
+  bool spectating = false;
+  bool hasJoined = false;
+  bool wasRefused = false;
+  uint32_t matchId = 0;
+  int side = 0;
+  double lastJoinSent = -1e9;
+  double lastAckSent = -1e9;
+  double lastHeard;
+
+  GameState game;
+  SnapshotHistory history; // Snapshots arrive packed against one of these
+  uint8_t inputs[INPUT_HISTORY]; // Indexed by sequence % INPUT_HISTORY
+  uint32_t nextSequence = 0;
+  uint32_t acknowledged = 0; // The server has played every input before this
+
+  Paddle predicted; // The local paddle with every input sent played on it
+  Real correction = 0.0f; // How far the shown paddle is from the predicted one, shrinking every step
+  GameState view;
+  PredictionStats predictionStats;
+};
+
+#endif
@@ -0,0 +1,251 @@
+#include "server_protocol.h"
+#include <math.h>
+#include <algorithm>
+#include "bit_stream.h"
+
+const int POSITION_BITS = 16, VELOCITY_BITS = 16, TIMER_BITS = 16, SCORE_BITS = 5, FLAG_BITS = 4, SOUND_BITS = 3;
+// Quantization steps per pixel, per pixel a millisecond and per millisecond. The predictions
+// below work in integers from these so they always agree with the quantizer.
+constexpr int32_t POSITION_SCALE_INT = 16;
+constexpr int32_t VELOCITY_SCALE_INT = 4096;
+constexpr int32_t TIMER_SCALE_INT = 8;
+const float POSITION_SCALE = float(POSITION_SCALE_INT);
+const float VELOCITY_SCALE = float(VELOCITY_SCALE_INT);
+const float TIMER_SCALE = float(TIMER_SCALE_INT);
+// Positions are stored from this far left of and above the court so balls past a goal stay positive
+const int32_t POSITION_OFFSET = 1024 * POSITION_SCALE_INT;
+
+void SnapshotHistory::add(const MatchSnapshot& snapshot) {
+  int slot = (snapshot.tick / STEPS_PER_SERVER_TICK) % SNAPSHOT_HISTORY;
+  snapshots[slot] = snapshot;
+  filled[slot] = true;
+  if (!hasAny || snapshot.tick > newest) newest = snapshot.tick;
+  hasAny = true;
+}
+
+const MatchSnapshot* SnapshotHistory::find(uint32_t tick) const {
+  int slot = (tick / STEPS_PER_SERVER_TICK) % SNAPSHOT_HISTORY;
+  return filled[slot] && snapshots[slot].tick == tick ? &snapshots[slot] : NULL;
+}
+
+const MatchSnapshot* SnapshotHistory::findShort(uint32_t shortTick) const {
+  int slot = shortTick % SNAPSHOT_HISTORY;
+  uint32_t mask = (1 << SHORT_TICK_BITS) - 1;
+  bool matches = filled[slot] && (snapshots[slot].tick / STEPS_PER_SERVER_TICK & mask) == shortTick;
+  return matches ? &snapshots[slot] : NULL;
+}
+
+static int32_t quantize(Real value, float scale) {
+  return int32_t(lroundf(float(value) * scale));
+}
+
+// Kept within what a whole snapshot can hold, so a baseline is always exactly what the receiver has
+static int32_t quantizePosition(Real value) {
+  return std::min((1 << POSITION_BITS) - 1 - POSITION_OFFSET, std::max(-POSITION_OFFSET, quantize(value, POSITION_SCALE)));
+}
+
+static int32_t quantizeSigned(Real value, float scale) {
+  return std::min(32767, std::max(-32768, quantize(value, scale)));
+}
+
+void captureSnapshot(const GameState* game, MatchSnapshot* snapshot) {
+  snapshot->tick = game->tick;
+  snapshot->ballX = quantizePosition(game->ball.rect.x);
+  snapshot->ballY = quantizePosition(game->ball.rect.y);
+  snapshot->ballVelX = quantizeSigned(game->ball.velX, VELOCITY_SCALE);
+  snapshot->ballVelY = quantizeSigned(game->ball.velY, VELOCITY_SCALE);
+  snapshot->paddleLeftY = quantizePosition(game->paddleLeft.rect.y);
+  snapshot->paddleRightY = quantizePosition(game->paddleRight.rect.y);
+  snapshot->paddleLeftVelocity = quantizeSigned(game->paddleLeft.velocity, VELOCITY_SCALE);
+  snapshot->paddleRightVelocity = quantizeSigned(game->paddleRight.velocity, VELOCITY_SCALE);
+  snapshot->ballRespawnTime = quantizeSigned(game->ballRespawnTime, TIMER_SCALE);
+  snapshot->scoreLeft = uint8_t(game->paddleLeft.score);
+  snapshot->scoreRight = uint8_t(game->paddleRight.score);
+  snapshot->flags = (game->leftSideServing ? SNAPSHOT_LEFT_SERVING : 0) |
+    (game->ballRespawning ? SNAPSHOT_RESPAWNING : 0) |
+    (game->gameOver ? SNAPSHOT_GAME_OVER : 0) |
+    (game->ballTeleported ? SNAPSHOT_TELEPORTED : 0);
+  snapshot->soundEvents = uint8_t(game->soundEvents);
+}
+
+void applySnapshot(const MatchSnapshot* snapshot, GameState* game) {
+  game->tick = snapshot->tick;
+  game->ball.rect.x = Real(snapshot->ballX / POSITION_SCALE);
+  game->ball.rect.y = Real(snapshot->ballY / POSITION_SCALE);
+  game->ball.velX = Real(snapshot->ballVelX / VELOCITY_SCALE);
+  game->ball.velY = Real(snapshot->ballVelY / VELOCITY_SCALE);
+  game->paddleLeft.rect.y = Real(snapshot->paddleLeftY / POSITION_SCALE);
+  game->paddleRight.rect.y = Real(snapshot->paddleRightY / POSITION_SCALE);
+  game->paddleLeft.velocity = Real(snapshot->paddleLeftVelocity / VELOCITY_SCALE);
+  game->paddleRight.velocity = Real(snapshot->paddleRightVelocity / VELOCITY_SCALE);
+  game->ballRespawnTime = Real(snapshot->ballRespawnTime / TIMER_SCALE);
+  game->paddleLeft.score = snapshot->scoreLeft;
+  game->paddleRight.score = snapshot->scoreRight;
+  game->leftSideServing = snapshot->flags & SNAPSHOT_LEFT_SERVING;
+  game->ballRespawning = snapshot->flags & SNAPSHOT_RESPAWNING;
+  game->gameOver = snapshot->flags & SNAPSHOT_GAME_OVER;
+  game->ballTeleported = snapshot->flags & SNAPSHOT_TELEPORTED;
+  game->soundEvents |= snapshot->soundEvents;
+}
+
+// Integer division rounded to nearest, the same on every machine so both ends predict alike
+static int32_t divideRounded(int64_t numerator, int64_t denominator) {
+  return int32_t(numerator >= 0 ? (numerator + denominator / 2) / denominator
+    : -((-numerator + denominator / 2) / denominator));
+}
+
+// How far something moving at a quantized velocity goes in whole steps, in quantized position
+static int32_t travel(int32_t velocity, uint32_t steps) {
+  // velocity / VELOCITY_SCALE * steps * SIMULATION_STEP * POSITION_SCALE, kept exact
+  return divideRounded(int64_t(velocity) * steps * 1000 * POSITION_SCALE_INT, int64_t(STEPS_PER_SECOND) * VELOCITY_SCALE_INT);
+}
+
+static int32_t predictPaddle(int32_t y, int32_t velocity, uint32_t steps) {
+  static const int32_t lowest = quantize(WINDOW_HEIGHT - PADDLE_HEIGHT, POSITION_SCALE);
+  return std::min(lowest, std::max(0, y - travel(velocity, steps)));
+}
+
+// Where the baseline says every field should be after the steps since it, everything keeps going
+// in a straight line, paddles stop at the walls, and the respawn timer keeps counting down.
+// Velocities going up are positive like in the game.
+static void predictSnapshot(const MatchSnapshot* baseline, uint32_t tick, MatchSnapshot* predicted) {
+  uint32_t steps = tick - baseline->tick;
+  *predicted = *baseline;
+  predicted->tick = tick;
+  predicted->ballX += travel(baseline->ballVelX, steps);
+  predicted->ballY -= travel(baseline->ballVelY, steps);
+  predicted->paddleLeftY = predictPaddle(baseline->paddleLeftY, baseline->paddleLeftVelocity, steps);
+  predicted->paddleRightY = predictPaddle(baseline->paddleRightY, baseline->paddleRightVelocity, steps);
+  if (baseline->flags & SNAPSHOT_RESPAWNING) {
+    predicted->ballRespawnTime -= divideRounded(int64_t(steps) * 1000 * TIMER_SCALE_INT, STEPS_PER_SECOND);
+  }
+}
+
+static uint32_t zigzag(int32_t value) {
+  return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value) {
+  return int32_t(value >> 1) ^ -int32_t(value & 1);
+}
+
+// A 0 bit for no difference, otherwise a 1, then the zigzagged difference in the smallest of these
+// sizes it fits in, each size after the first marked by one more 1 bit before a 0
+const int DIFFERENCE_SIZES[] = {4, 8, 16, 32};
+const int DIFFERENCE_SIZE_COUNT = 4;
+
+static void writeDifference(BitWriter* writer, int32_t difference) {
+  writer->write(difference != 0, 1);
+  if (difference == 0) {
+    return;
+  }
+  uint32_t value = zigzag(difference);
+  int size = 0;
+  while (size + 1 < DIFFERENCE_SIZE_COUNT && value >> DIFFERENCE_SIZES[size] != 0) {
+    writer->write(1, 1);
+    ++size;
+  }
+  if (size + 1 < DIFFERENCE_SIZE_COUNT) writer->write(0, 1);
+  writer->write(value, DIFFERENCE_SIZES[size]);
+}
+
+static int32_t readDifference(BitReader* reader) {
+  if (!reader->read(1)) {
+    return 0;
+  }
+  int size = 0;
+  while (size + 1 < DIFFERENCE_SIZE_COUNT && reader->read(1)) {
+    ++size;
+  }
+  return unzigzag(reader->read(DIFFERENCE_SIZES[size]));
+}
+
+// Small values that rarely change, a 0 bit when they haven't
+static void writeIfChanged(BitWriter* writer, uint32_t value, uint32_t previous, int bits) {
+  writer->write(value != previous, 1);
+  if (value != previous) writer->write(value, bits);
+}
+
+static uint32_t readIfChanged(BitReader* reader, uint32_t previous, int bits) {
+  return reader->read(1) ? reader->read(bits) : previous;
+}
+
+int encodeSnapshot(const MatchSnapshot* snapshot, const MatchSnapshot* baseline, uint8_t* out, int capacity) {
+  BitWriter writer(out, capacity);
+  writer.write(baseline != NULL, 1);
+  if (!baseline) {
+    writer.write(snapshot->tick, 32);
+    writer.write(snapshot->ballX + POSITION_OFFSET, POSITION_BITS);
+    writer.write(snapshot->ballY + POSITION_OFFSET, POSITION_BITS);
+    writer.write(zigzag(snapshot->ballVelX), VELOCITY_BITS);
+    writer.write(zigzag(snapshot->ballVelY), VELOCITY_BITS);
+    writer.write(snapshot->paddleLeftY + POSITION_OFFSET, POSITION_BITS);
+    writer.write(snapshot->paddleRightY + POSITION_OFFSET, POSITION_BITS);
+    writer.write(zigzag(snapshot->paddleLeftVelocity), VELOCITY_BITS);
+    writer.write(zigzag(snapshot->paddleRightVelocity), VELOCITY_BITS);
+    writer.write(zigzag(snapshot->ballRespawnTime), TIMER_BITS);
+    writer.write(snapshot->scoreLeft, SCORE_BITS);
+    writer.write(snapshot->scoreRight, SCORE_BITS);
+    writer.write(snapshot->flags, FLAG_BITS);
+  } else {
+    // The baseline is named by its short tick, and the tick is how many steps came after it
+    writer.write(baseline->tick / STEPS_PER_SERVER_TICK, SHORT_TICK_BITS);
+    writeDifference(&writer, int32_t(snapshot->tick - baseline->tick));
+    MatchSnapshot predicted;
+    predictSnapshot(baseline, snapshot->tick, &predicted);
+    writeDifference(&writer, snapshot->ballX - predicted.ballX);
+    writeDifference(&writer, snapshot->ballY - predicted.ballY);
+    writeDifference(&writer, snapshot->ballVelX - predicted.ballVelX);
+    writeDifference(&writer, snapshot->ballVelY - predicted.ballVelY);
+    writeDifference(&writer, snapshot->paddleLeftY - predicted.paddleLeftY);
+    writeDifference(&writer, snapshot->paddleRightY - predicted.paddleRightY);
+    writeDifference(&writer, snapshot->paddleLeftVelocity - predicted.paddleLeftVelocity);
+    writeDifference(&writer, snapshot->paddleRightVelocity - predicted.paddleRightVelocity);
+    writeDifference(&writer, snapshot->ballRespawnTime - predicted.ballRespawnTime);
+    writeIfChanged(&writer, snapshot->scoreLeft, predicted.scoreLeft, SCORE_BITS);
+    writeIfChanged(&writer, snapshot->scoreRight, predicted.scoreRight, SCORE_BITS);
+    writeIfChanged(&writer, snapshot->flags, predicted.flags, FLAG_BITS);
+  }
+  // Sounds happen once, they're never predicted
+  writeIfChanged(&writer, snapshot->soundEvents, 0, SOUND_BITS);
+  return writer.overflowed() ? 0 : writer.bytes();
+}
+
+bool decodeSnapshot(const uint8_t* in, int size, const SnapshotHistory* history, MatchSnapshot* snapshot) {
+  BitReader reader(in, size);
+  if (!reader.read(1)) {
+    snapshot->tick = reader.read(32);
+    snapshot->ballX = int32_t(reader.read(POSITION_BITS)) - POSITION_OFFSET;
+    snapshot->ballY = int32_t(reader.read(POSITION_BITS)) - POSITION_OFFSET;
+    snapshot->ballVelX = unzigzag(reader.read(VELOCITY_BITS));
+    snapshot->ballVelY = unzigzag(reader.read(VELOCITY_BITS));
+    snapshot->paddleLeftY = int32_t(reader.read(POSITION_BITS)) - POSITION_OFFSET;
+    snapshot->paddleRightY = int32_t(reader.read(POSITION_BITS)) - POSITION_OFFSET;
+    snapshot->paddleLeftVelocity = unzigzag(reader.read(VELOCITY_BITS));
+    snapshot->paddleRightVelocity = unzigzag(reader.read(VELOCITY_BITS));
+    snapshot->ballRespawnTime = unzigzag(reader.read(TIMER_BITS));
+    snapshot->scoreLeft = uint8_t(reader.read(SCORE_BITS));
+    snapshot->scoreRight = uint8_t(reader.read(SCORE_BITS));
+    snapshot->flags = uint8_t(reader.read(FLAG_BITS));
+  } else {
+    const MatchSnapshot* baseline = history->findShort(reader.read(SHORT_TICK_BITS));
+    if (!baseline) {
+      return false;
+    }
+    predictSnapshot(baseline, baseline->tick + uint32_t(readDifference(&reader)), snapshot);
+    snapshot->ballX += readDifference(&reader);
+    snapshot->ballY += readDifference(&reader);
+    snapshot->ballVelX += readDifference(&reader);
+    snapshot->ballVelY += readDifference(&reader);
+    snapshot->paddleLeftY += readDifference(&reader);
+    snapshot->paddleRightY += readDifference(&reader);
+    snapshot->paddleLeftVelocity += readDifference(&reader);
+    snapshot->paddleRightVelocity += readDifference(&reader);
+    snapshot->ballRespawnTime += readDifference(&reader);
+    snapshot->scoreLeft = uint8_t(readIfChanged(&reader, snapshot->scoreLeft, SCORE_BITS));
+    snapshot->scoreRight = uint8_t(readIfChanged(&reader, snapshot->scoreRight, SCORE_BITS));
+    snapshot->flags = uint8_t(readIfChanged(&reader, snapshot->flags, FLAG_BITS));
+  }
+  snapshot->soundEvents = uint8_t(readIfChanged(&reader, 0, SOUND_BITS));
+  return !reader.overflowed();
+}
@@ -0,0 +1,81 @@
+#ifndef SERVER_PROTOCOL_H
+#define SERVER_PROTOCOL_H
+
+#include "game.h"
+#include "net.h"
+
+// What pong-server and the players on it send each other. The server plays every match and
+// decides everything that happens in it; players only send their paddle's input for each
+// step and get the match back as a snapshot every server tick.
+
+const uint8_t SERVER_PROTOCOL_VERSION = 3;
+const int SERVER_TICK_RATE = 120; // Ticks a second
+const int STEPS_PER_SERVER_TICK = 2; // Simulation steps played each tick, 240 Hz like everywhere else
+const int MAX_SENT_INPUTS = 32; // Most unacknowledged inputs repeated in one input packet
+const int MAX_SERVER_PACKET = 256;
+
+enum ServerPacketType : uint8_t {
+  SERVER_JOIN = 16, // Player to server: protocol version, SimulationFlags
+  SERVER_JOINED = 17, // Server to player: protocol version, SimulationFlags, match id, side
+  SERVER_INPUT = 18, // Player to server: match id, latest snapshot tick, first input sequence, count, inputs
+  SERVER_STATE = 19, // Server to player or spectator: match id, inputs played, packed snapshot
+  SERVER_SPECTATE = 20, // Spectator to server: protocol version, SimulationFlags, match id
+  SERVER_SPECTATING = 21, // Server to spectator: protocol version, SimulationFlags, match id, whether it exists
+  SERVER_SPECTATOR_ACK = 22 // Spectator to server: match id, latest snapshot tick
+};
+
+enum SnapshotFlags {
+  SNAPSHOT_LEFT_SERVING = 1,
+  SNAPSHOT_RESPAWNING = 2,
+  SNAPSHOT_GAME_OVER = 4,
+  SNAPSHOT_TELEPORTED = 8 // The ball jumped since the last snapshot so it shouldn't be interpolated
+};
+
+// Everything a player needs to draw the match, the AI and random number state stay on the
+// server. Quantized so it packs small: positions are in sixteenths of a pixel, velocities in
+// 4096ths of a pixel a millisecond, and the respawn timer in eighths of a millisecond.
+struct MatchSnapshot {
+  uint32_t tick = 0;
+  int32_t ballX = 0, ballY = 0, ballVelX = 0, ballVelY = 0;
+  int32_t paddleLeftY = 0, paddleRightY = 0, paddleLeftVelocity = 0, paddleRightVelocity = 0;
+  int32_t ballRespawnTime = 0;
+  uint8_t scoreLeft = 0, scoreRight = 0;
+  uint8_t flags = 0; // SnapshotFlags
+  uint8_t soundEvents = 0; // GameSound flags raised since the last snapshot
+};
+
+const int SNAPSHOT_HISTORY = 64; // Snapshots kept to encode against, about half a second of ticks
+const int SHORT_TICK_BITS = 10; // Enough of a snapshot's tick to name it as a baseline
+const int MAX_SNAPSHOT_BYTES = 64;
+
+// The last SNAPSHOT_HISTORY snapshots of a match, one per tick
+class SnapshotHistory {
+public:
+  void add(const MatchSnapshot& snapshot);
+  // NULL once it's too old
+  const MatchSnapshot* find(uint32_t tick) const;
+  // Finds a snapshot from the low SHORT_TICK_BITS of its server tick, tick / STEPS_PER_SERVER_TICK
+  const MatchSnapshot* findShort(uint32_t shortTick) const;
+  bool empty() const { return !hasAny; }
+  uint32_t newestTick() const { return newest; }
+
+private:
+  MatchSnapshot snapshots[SNAPSHOT_HISTORY];
+  bool filled[SNAPSHOT_HISTORY] = {};
+  bool hasAny = false;
+  uint32_t newest = 0;
+};
+
+void captureSnapshot(const GameState* game, MatchSnapshot* snapshot);
+// Puts what the snapshot holds into the game, leaving everything else alone
+void applySnapshot(const MatchSnapshot* snapshot, GameState* game);
+
+// Bit packs a snapshot, whole when baseline is NULL and otherwise as how far it is from where
+// the baseline says everything would have got to by now, which is usually nothing at all.
+// Returns the bytes written.
+int encodeSnapshot(const MatchSnapshot* snapshot, const MatchSnapshot* baseline, uint8_t* out, int capacity);
+// Unpacks a snapshot, finding the baseline it was packed against in the history. Returns false
+// if it's malformed or the baseline's no longer there.
+bool decodeSnapshot(const uint8_t* in, int size, const SnapshotHistory* history, MatchSnapshot* snapshot);
+
+#endif
@@ -0,0 +1,120 @@
+#include "shared_buffers.h"
+#include <string.h>
+#include <new>
+#include <thread>
+#include <chrono>
+#include <errno.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Spins this many times waiting for the trainer before checking stop and giving up the core,
+// so a trainer that keeps up never costs a system call but one that doesn't still gets to run
+const int WAIT_SPINS = 1024;
+
+static uint32_t roundUpToCacheLine(size_t bytes) {
+  return uint32_t((bytes + 63) / 64 * 64);
+}
+
+#ifdef _WIN32
+
+SharedBuffers::SharedBuffers(const char*, int) {
+  errorText = "Creating Shared Memory (Only Possible On POSIX Systems)";
+}
+
+SharedBuffers::~SharedBuffers() {}
+
+#else
+
+SharedBuffers::SharedBuffers(const char* segmentName, int matches) {
+  // POSIX names start with a slash and have no others
+  if (segmentName[0] == '/') ++segmentName;
+  if (strlen(segmentName) == 0 || strlen(segmentName) + 2 > sizeof(name) || strchr(segmentName, '/')) {
+    errorText = "Naming Shared Memory";
+    return;
+  }
+  name[0] = '/';
+  strcpy(name + 1, segmentName);
+
+  uint32_t observationBytes = roundUpToCacheLine(SHARED_FIELDS * sizeof(float) * matches);
+  uint32_t actionBytes = roundUpToCacheLine(matches);
+  size = sizeof(SharedBuffersHeader) + observationBytes + actionBytes;
+
+  // Never unlinked first, the name may belong to another simulation and trainer still running
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    errorText = errno == EEXIST ? "Creating Shared Memory (Name Already In Use)" : "Creating Shared Memory";
+    return;
+  }
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    shm_unlink(name);
+    errorText = "Sizing Shared Memory";
+    return;
+  }
+  void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd); // The mapping keeps it alive
+  if (memory == MAP_FAILED) {
+    shm_unlink(name);
+    errorText = "Mapping Shared Memory";
+    return;
+  }
+
+  // Fresh shared memory is zeroed, the header is built in it and the magic set last so a
+  // trainer that sees the magic knows the rest is ready
+  SharedBuffersHeader* created = new (memory) SharedBuffersHeader();
+  created->matches = matches;
+  created->observationBytes = observationBytes;
+  created->actionBytes = actionBytes;
+  created->observationSequence.store(0);
+  created->actionSequence.store(0);
+  created->stop.store(0);
+  created->version = SHARED_BUFFERS_VERSION;
+  created->magic.store(SHARED_BUFFERS_MAGIC, std::memory_order_release);
+  header = created;
+  observations = (uint8_t*)memory + sizeof(SharedBuffersHeader);
+  actions = observations + observationBytes;
+}
+
+SharedBuffers::~SharedBuffers() {
+  if (header) {
+    munmap(header, size);
+    shm_unlink(name);
+  }
+}
+
+#endif
+
+float* SharedBuffers::observationBuffer() {
+  return (float*)observations;
+}
+
+void SharedBuffers::publishObservations(uint64_t n) {
+  header->observationSequence.store(n + 1, std::memory_order_release);
+}
+
+const uint8_t* SharedBuffers::waitForActions(uint64_t n) {
+  // The clock is only read once the spinning's done, a trainer that keeps up never pays for it
+  auto deadline = std::chrono::steady_clock::time_point::max();
+  int spins = 0;
+  while (header->actionSequence.load(std::memory_order_acquire) <= n) {
+    if (++spins < WAIT_SPINS) {
+      continue;
+    }
+    if (header->stop.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (deadline == std::chrono::steady_clock::time_point::max()) {
+      deadline = now + std::chrono::milliseconds(n == 0 ? TRAINER_ATTACH_TIMEOUT : TRAINER_TIMEOUT);
+    } else if (now >= deadline) {
+      lost = true;
+      return nullptr;
+    }
+    std::this_thread::yield();
+    spins = 0;
+  }
+  return actions;
+}
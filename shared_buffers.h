@@ -0,0 +1,90 @@
+#ifndef SHARED_BUFFERS_H
+#define SHARED_BUFFERS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Hands observations for many matches to a trainer in another process through a buffer pair
+// in POSIX shared memory and takes its actions back, with nothing copied through the kernel
+// and no system calls per step. Each side only ever writes its own sequence counter, so they
+// stay in step with plain atomic loads and stores.
+//
+// The segment is a SharedBuffersHeader followed by the buffer pair: the observation buffer
+// then the action buffer, every step reusing the same two. The trainer waits for magic to be
+// SHARED_BUFFERS_MAGIC, loading it with acquire, before reading anything else.
+//   Observations: SHARED_FIELDS rows of one float per match, see SharedField, padded to a
+//     multiple of 64 bytes. Matches are mirrored so the trainer's paddle is on the right.
+//   Actions: one byte per match, 0 to stay, 1 to move up, 2 to move down.
+// The simulation writes the observations for step n then sets observationSequence to n + 1.
+// The trainer reads them, writes its actions for step n then sets actionSequence to n + 1,
+// and only then does the simulation step the matches and overwrite the observations. So the
+// trainer must be done reading before it publishes its actions. The trainer sets stop to end it,
+// and the simulation gives up on a trainer that takes too long to attach or answer.
+
+const uint32_t SHARED_BUFFERS_MAGIC = 0x4d485350; // "PSHM"
+const uint32_t SHARED_BUFFERS_VERSION = 2;
+const int TRAINER_ATTACH_TIMEOUT = 60000; // Milliseconds to wait for the trainer's first actions
+const int TRAINER_TIMEOUT = 10000; // Milliseconds to wait for any actions after that
+
+enum SharedField {
+  SHARED_PADDLE_Y,
+  SHARED_OPPONENT_Y,
+  SHARED_BALL_X,
+  SHARED_BALL_Y,
+  SHARED_BALL_VEL_X,
+  SHARED_BALL_VEL_Y,
+  SHARED_BALL_IN_PLAY,
+  SHARED_SCORE,
+  SHARED_OPPONENT_SCORE,
+  SHARED_REWARD, // +1 or -1 for a point scored in the step that led to these observations
+  SHARED_DONE, // 1 if the match ended in that step and these are from the next one
+  SHARED_FIELDS
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "The sequence counters must work across processes");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "The magic and stop must work across processes");
+
+struct SharedBuffersHeader {
+  std::atomic<uint32_t> magic; // Set last, with release, once everything else is ready
+  uint32_t version;
+  uint32_t matches;
+  uint32_t observationBytes;
+  uint32_t actionBytes;
+  // Each counter on its own cache line so the two sides don't slow each other down
+  alignas(64) std::atomic<uint64_t> observationSequence;
+  alignas(64) std::atomic<uint64_t> actionSequence;
+  alignas(64) std::atomic<uint32_t> stop;
+};
+
+// The simulation's side of the buffers
+class SharedBuffers {
+public:
+  // Creates the shared memory object, failing if one with the same name is still there since
+  // another simulation may be using it. Check isOpen afterwards, error names the step that failed.
+  SharedBuffers(const char* name, int matches);
+  ~SharedBuffers();
+  bool isOpen() const { return header != nullptr; }
+  const char* error() const { return errorText; }
+
+  // Where to fill in the observations, only once the trainer's actions for the last step are in
+  float* observationBuffer();
+  // Makes the observations of step n visible to the trainer
+  void publishObservations(uint64_t n);
+  // Waits for the trainer's actions for step n, returns nullptr if it asked to stop instead or
+  // stopped answering, see trainerLost
+  const uint8_t* waitForActions(uint64_t n);
+  // Whether waitForActions gave up because the trainer took too long
+  bool trainerLost() const { return lost; }
+
+private:
+  SharedBuffersHeader* header = nullptr;
+  uint8_t* observations = nullptr;
+  uint8_t* actions = nullptr;
+  size_t size = 0;
+  char name[256];
+  const char* errorText = "";
+  bool lost = false;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef TRIG_H
+#define TRIG_H
+
+#include "fixed.h"
+
+// Table driven sin and cos for Fixed. The table is worked out by the compiler from a Taylor
+// series so it comes out the same everywhere, and lookups only use integer maths.
+// Linear interpolation between 1024 steps per turn keeps the error under 0.00003.
+
+const int SINE_TABLE_STEPS = 1024; // Steps in a full turn, must be a power of two
+
+struct SineTable {
+  int32_t values[SINE_TABLE_STEPS + 1]; // Q16.16, the extra entry saves wrapping when interpolating
+};
+
+constexpr double taylorSin(double radians) {
+  double term = radians, sum = radians;
+  for (int n = 1; n < 20; ++n) {
+    term *= -radians * radians / ((2 * n) * (2 * n + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr double taylorCos(double radians) {
+  return taylorSin(radians + 3.14159265358979323846 / 2);
+}
+
+constexpr SineTable makeSineTable() {
+  const double pi = 3.14159265358979323846;
+  SineTable table {};
+  for (int i = 0; i <= SINE_TABLE_STEPS; ++i) {
+    // Keep the series near zero where it converges fastest
+    double radians = 2 * pi * i / SINE_TABLE_STEPS;
+    if (radians > pi) radians -= 2 * pi;
+    table.values[i] = Fixed(taylorSin(radians)).raw;
+  }
+  return table;
+}
+
+constexpr SineTable SINE_TABLE = makeSineTable();
+
+// Table steps per radian as Q16.16
+const int64_t SINE_STEPS_PER_RADIAN = Fixed(SINE_TABLE_STEPS / (2 * 3.14159265358979323846)).raw;
+
+// Looks up an angle given in table steps as Q16.16, any angle works since it wraps every turn
+inline Fixed sineOfSteps(int64_t steps) {
+  int index = int(steps >> Fixed::FRACTION_BITS) & (SINE_TABLE_STEPS - 1);
+  int64_t fraction = steps & (Fixed::ONE - 1);
+  int32_t from = SINE_TABLE.values[index], to = SINE_TABLE.values[index + 1];
+  return Fixed::fromRaw(from + int32_t(((to - from) * fraction) >> Fixed::FRACTION_BITS));
+}
+
+inline Fixed sin(Fixed radians) {
+  return sineOfSteps((radians.raw * SINE_STEPS_PER_RADIAN) >> Fixed::FRACTION_BITS);
+}
+
+inline Fixed cos(Fixed radians) {
+  // A quarter turn ahead of sin
+  return sineOfSteps(((radians.raw * SINE_STEPS_PER_RADIAN) >> Fixed::FRACTION_BITS) +
+    (int64_t(SINE_TABLE_STEPS / 4) << Fixed::FRACTION_BITS));
+}
+
+#endif